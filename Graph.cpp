@@ -7,6 +7,20 @@
 #include <sstream>
 #include <functional>
 #include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+#include <map>
+#include <string_view>
+#include <deque>
+#include <mutex>
+#include <memory_resource>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <type_traits>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
@@ -19,239 +33,3497 @@ using glm::vec4;
 using glm::mat4;
 using glm::quat;
 
+// ---------------------------------------------
+// SIMD support (x86 SSE baseline, AVX2 selected at runtime)
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SG_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(SG_X86) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define SG_SSE 1
+#endif
+
+#if defined(SG_SSE) && (defined(__GNUC__) || defined(__clang__))
+#define SG_AVX2 1
+// No fma: the compiler would fuse the mul/add intrinsics, and the AVX2 paths
+// must give the same results as their SSE and scalar counterparts.
+#define SG_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+inline bool cpuHasAVX2() {
+#if defined(SG_AVX2)
+    static const bool has = __builtin_cpu_supports("avx2");
+    return has;
+#else
+    return false;
+#endif
+}
+
+// ---------------------------------------------
+// String interning
+//
+// Node and mesh names are interned once into a process-wide table and then
+// carried as 32-bit Symbols: comparisons and hashing are integer operations
+// and copying a name never allocates. Id 0 is the empty string.
+
+class StringTable {
+    std::deque<std::string> strings{std::string()};   // deque keeps references stable
+    std::unordered_map<std::string_view, uint32_t> ids{{std::string_view(), 0}};
+    mutable std::mutex mutex;
+public:
+    static StringTable& instance() {
+        static StringTable table;
+        return table;
+    }
+
+    uint32_t intern(std::string_view s) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(s);
+        if (it != ids.end()) return it->second;
+        strings.emplace_back(s);
+        uint32_t id = uint32_t(strings.size() - 1);
+        ids.emplace(strings.back(), id);
+        return id;
+    }
+
+    // Returns 0 when s has never been interned; never inserts.
+    uint32_t find(std::string_view s) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = ids.find(s);
+        return it != ids.end() ? it->second : 0;
+    }
+
+    const std::string& str(uint32_t id) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return strings[id];
+    }
+};
+
+class Symbol {
+    uint32_t id = 0;
+public:
+    Symbol() = default;
+    explicit Symbol(std::string_view s) : id(StringTable::instance().intern(s)) {}
+
+    // Symbol for s if it was interned before, the empty Symbol otherwise.
+    static Symbol lookup(std::string_view s) {
+        Symbol sym;
+        sym.id = StringTable::instance().find(s);
+        return sym;
+    }
+
+    uint32_t value() const { return id; }
+    bool empty() const     { return id == 0; }
+    const std::string& str() const { return StringTable::instance().str(id); }
+
+    bool operator==(Symbol o) const { return id == o.id; }
+    bool operator!=(Symbol o) const { return id != o.id; }
+    bool operator<(Symbol o) const  { return id < o.id; }
+};
+
+inline std::ostream& operator<<(std::ostream& os, Symbol s) { return os << s.str(); }
+
+namespace std {
+template<> struct hash<Symbol> {
+    size_t operator()(Symbol s) const noexcept { return std::hash<uint32_t>()(s.value()); }
+};
+}
+
 // ---------------------------------------------
 // Physics preparation (bounding boxes)
 
-struct BoundingBox {
-    vec3 min, max;
+struct BoundingBox {
+    vec3 min, max;
+
+    vec3 center()  const { return (min + max) * 0.5f; }
+    vec3 extents() const { return (max - min) * 0.5f; }
+
+    bool contains(const BoundingBox& o) const {
+        return o.min.x >= min.x && o.min.y >= min.y && o.min.z >= min.z
+            && o.max.x <= max.x && o.max.y <= max.y && o.max.z <= max.z;
+    }
+    bool overlaps(const BoundingBox& o) const {
+        return o.min.x <= max.x && o.min.y <= max.y && o.min.z <= max.z
+            && o.max.x >= min.x && o.max.y >= min.y && o.max.z >= min.z;
+    }
+
+    // Surface area, the cost measure of the SAH-built trees.
+    float surfaceArea() const {
+        vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    void expand(const BoundingBox& o) {
+        min = glm::min(min, o.min);
+        max = glm::max(max, o.max);
+    }
+    void expand(const vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    bool operator==(const BoundingBox& o) const { return min == o.min && max == o.max; }
+    bool operator!=(const BoundingBox& o) const { return !(*this == o); }
+
+    static BoundingBox fromCenterExtents(const vec3& c, const vec3& e) { return {c - e, c + e}; }
+    static BoundingBox merge(const BoundingBox& a, const BoundingBox& b) {
+        return {glm::min(a.min, b.min), glm::max(a.max, b.max)};
+    }
+    // Inverted box that the first expand() replaces.
+    static BoundingBox empty() {
+        float inf = std::numeric_limits<float>::max();
+        return {vec3(inf), vec3(-inf)};
+    }
+};
+
+// Axis-aligned box enclosing bb after an affine transform.
+inline BoundingBox transformBox(const BoundingBox& bb, const mat4& m) {
+    vec3 c = bb.center(), e = bb.extents();
+    vec3 wc = vec3(m * vec4(c, 1.0f));
+    vec3 we(
+        std::fabs(m[0][0]) * e.x + std::fabs(m[1][0]) * e.y + std::fabs(m[2][0]) * e.z,
+        std::fabs(m[0][1]) * e.x + std::fabs(m[1][1]) * e.y + std::fabs(m[2][1]) * e.z,
+        std::fabs(m[0][2]) * e.x + std::fabs(m[1][2]) * e.y + std::fabs(m[2][2]) * e.z);
+    return BoundingBox::fromCenterExtents(wc, we);
+}
+
+// ---------------------------------------------
+// Transform class
+
+class Transform {
+private:
+    vec3 position;
+    quat rotation;
+    vec3 scale;
+    mutable mat4 localMatrix;
+    mutable bool dirty;
+    uint32_t version;   // bumped by every setter; readers keep their own last-seen copy
+public:
+    Transform()
+        : position(0.0f), rotation(quat()), scale(1.0f),
+          localMatrix(1.0f), dirty(true), version(0) {}
+
+    void setPosition(const vec3& pos) { position = pos; dirty = true; ++version; }
+    void setRotation(const quat& rot)  { rotation = rot; dirty = true; ++version; }
+    void setScale(const vec3& scl)     { scale    = scl; dirty = true; ++version; }
+
+    uint32_t getVersion() const { return version; }
+
+    vec3 getPosition() const { return position; }
+    quat getRotation() const { return rotation; }
+    vec3 getScale()    const { return scale; }
+
+    mat4 getMatrix() const {
+        if (dirty) {
+            mat4 t = glm::translate(mat4(1.0f), position);
+            mat4 r = glm::mat4_cast(rotation);
+            mat4 s = glm::scale(mat4(1.0f), scale);
+            localMatrix = t * r * s;
+            dirty = false;
+        }
+        return localMatrix;
+    }
+};
+
+// ---------------------------------------------
+// Pooled transforms (structure of arrays)
+//
+// Optional store for large animated sets: every TRS component lives in its
+// own contiguous array indexed by slot, so composeLocal() can build 4 (SSE)
+// or 8 (AVX2) local matrices per iteration.
+
+class TransformPool {
+public:
+    std::vector<float> px, py, pz;
+    std::vector<float> qx, qy, qz, qw;
+    std::vector<float> sx, sy, sz;
+    std::vector<mat4>  local, world;
+
+    size_t size() const { return px.size(); }
+
+    uint32_t add(const Transform& t = Transform()) {
+        px.push_back(0); py.push_back(0); pz.push_back(0);
+        qx.push_back(0); qy.push_back(0); qz.push_back(0); qw.push_back(1);
+        sx.push_back(1); sy.push_back(1); sz.push_back(1);
+        local.emplace_back(1.0f);
+        world.emplace_back(1.0f);
+        uint32_t i = uint32_t(size() - 1);
+        set(i, t);
+        return i;
+    }
+
+    void clear() {
+        for (auto* v : {&px,&py,&pz,&qx,&qy,&qz,&qw,&sx,&sy,&sz}) v->clear();
+        local.clear();
+        world.clear();
+    }
+
+    void set(uint32_t i, const Transform& t) {
+        setPosition(i, t.getPosition());
+        setRotation(i, t.getRotation());
+        setScale(i, t.getScale());
+    }
+    void setPosition(uint32_t i, const vec3& p) { px[i] = p.x; py[i] = p.y; pz[i] = p.z; }
+    void setRotation(uint32_t i, const quat& q) { qx[i] = q.x; qy[i] = q.y; qz[i] = q.z; qw[i] = q.w; }
+    void setScale(uint32_t i, const vec3& s)    { sx[i] = s.x; sy[i] = s.y; sz[i] = s.z; }
+
+    // Rebuilds local[begin, end) as T * R * S (same result as Transform::getMatrix).
+    void composeLocal(size_t begin, size_t end) {
+        size_t i = begin;
+#if defined(SG_AVX2)
+        if (cpuHasAVX2())
+            for (; i + 8 <= end; i += 8) composeAVX2(i);
+#endif
+#if defined(SG_SSE)
+        for (; i + 4 <= end; i += 4) composeSSE(i);
+#endif
+        for (; i < end; ++i) composeScalar(i);
+    }
+    void composeLocal() { composeLocal(0, size()); }
+
+    void composeScalar(size_t i) {
+        float x = qx[i], y = qy[i], z = qz[i], w = qw[i];
+        float xx = x*x, yy = y*y, zz = z*z;
+        float xy = x*y, xz = x*z, yz = y*z;
+        float wx = w*x, wy = w*y, wz = w*z;
+        mat4& m = local[i];
+        m[0] = vec4((1 - 2*(yy+zz)) * sx[i], 2*(xy+wz) * sx[i], 2*(xz-wy) * sx[i], 0);
+        m[1] = vec4(2*(xy-wz) * sy[i], (1 - 2*(xx+zz)) * sy[i], 2*(yz+wx) * sy[i], 0);
+        m[2] = vec4(2*(xz+wy) * sz[i], 2*(yz-wx) * sz[i], (1 - 2*(xx+yy)) * sz[i], 0);
+        m[3] = vec4(px[i], py[i], pz[i], 1);
+    }
+
+private:
+#if defined(SG_SSE)
+    // Writes one column for 4 consecutive slots: lanes of (a,b,c,d) are
+    // transposed so each slot receives its own (a,b,c,d) vec4.
+    static void storeColumns4(mat4* dst, int col, __m128 a, __m128 b, __m128 c, __m128 d) {
+        _MM_TRANSPOSE4_PS(a, b, c, d);
+        _mm_storeu_ps(&dst[0][col][0], a);
+        _mm_storeu_ps(&dst[1][col][0], b);
+        _mm_storeu_ps(&dst[2][col][0], c);
+        _mm_storeu_ps(&dst[3][col][0], d);
+    }
+
+    void composeSSE(size_t i) {
+        const __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        __m128 x = _mm_loadu_ps(&qx[i]), y = _mm_loadu_ps(&qy[i]);
+        __m128 z = _mm_loadu_ps(&qz[i]), w = _mm_loadu_ps(&qw[i]);
+        __m128 x2 = _mm_mul_ps(x, two), y2 = _mm_mul_ps(y, two), z2 = _mm_mul_ps(z, two);
+        __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+        __m128 s0 = _mm_loadu_ps(&sx[i]), s1 = _mm_loadu_ps(&sy[i]), s2 = _mm_loadu_ps(&sz[i]);
+
+        mat4* dst = &local[i];
+        storeColumns4(dst, 0,
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), s0),
+            _mm_mul_ps(_mm_add_ps(xy, wz), s0),
+            _mm_mul_ps(_mm_sub_ps(xz, wy), s0), zero);
+        storeColumns4(dst, 1,
+            _mm_mul_ps(_mm_sub_ps(xy, wz), s1),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), s1),
+            _mm_mul_ps(_mm_add_ps(yz, wx), s1), zero);
+        storeColumns4(dst, 2,
+            _mm_mul_ps(_mm_add_ps(xz, wy), s2),
+            _mm_mul_ps(_mm_sub_ps(yz, wx), s2),
+            _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), s2), zero);
+        storeColumns4(dst, 3,
+            _mm_loadu_ps(&px[i]), _mm_loadu_ps(&py[i]), _mm_loadu_ps(&pz[i]), one);
+    }
+#endif
+
+#if defined(SG_AVX2)
+    SG_TARGET_AVX2 static void storeColumns8(mat4* dst, int col, __m256 a, __m256 b, __m256 c, __m256 d) {
+        storeColumns4(dst,     col, _mm256_castps256_ps128(a), _mm256_castps256_ps128(b),
+                                    _mm256_castps256_ps128(c), _mm256_castps256_ps128(d));
+        storeColumns4(dst + 4, col, _mm256_extractf128_ps(a, 1), _mm256_extractf128_ps(b, 1),
+                                    _mm256_extractf128_ps(c, 1), _mm256_extractf128_ps(d, 1));
+    }
+
+    SG_TARGET_AVX2 void composeAVX2(size_t i) {
+        const __m256 one = _mm256_set1_ps(1.0f), two = _mm256_set1_ps(2.0f), zero = _mm256_setzero_ps();
+        __m256 x = _mm256_loadu_ps(&qx[i]), y = _mm256_loadu_ps(&qy[i]);
+        __m256 z = _mm256_loadu_ps(&qz[i]), w = _mm256_loadu_ps(&qw[i]);
+        __m256 x2 = _mm256_mul_ps(x, two), y2 = _mm256_mul_ps(y, two), z2 = _mm256_mul_ps(z, two);
+        __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+        __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+        __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+        __m256 s0 = _mm256_loadu_ps(&sx[i]), s1 = _mm256_loadu_ps(&sy[i]), s2 = _mm256_loadu_ps(&sz[i]);
+
+        mat4* dst = &local[i];
+        storeColumns8(dst, 0,
+            _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), s0),
+            _mm256_mul_ps(_mm256_add_ps(xy, wz), s0),
+            _mm256_mul_ps(_mm256_sub_ps(xz, wy), s0), zero);
+        storeColumns8(dst, 1,
+            _mm256_mul_ps(_mm256_sub_ps(xy, wz), s1),
+            _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), s1),
+            _mm256_mul_ps(_mm256_add_ps(yz, wx), s1), zero);
+        storeColumns8(dst, 2,
+            _mm256_mul_ps(_mm256_add_ps(xz, wy), s2),
+            _mm256_mul_ps(_mm256_sub_ps(yz, wx), s2),
+            _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), s2), zero);
+        storeColumns8(dst, 3,
+            _mm256_loadu_ps(&px[i]), _mm256_loadu_ps(&py[i]), _mm256_loadu_ps(&pz[i]), one);
+    }
+#endif
+};
+
+// ---------------------------------------------
+// Forward declaration
+
+class SceneNode;
+using SceneNodePtr = std::shared_ptr<SceneNode>;
+
+// ---------------------------------------------
+// Generational handles
+//
+// A NodeHandle names a slot plus the generation it was issued for; once the
+// slot is freed its generation moves on, so stale handles resolve to null in
+// O(1) instead of keeping the node alive the way a shared_ptr would.
+
+struct NodeHandle {
+    uint32_t index      = 0;
+    uint32_t generation = 0;   // 0 is never issued, so a default handle is null
+
+    bool isNull() const { return generation == 0; }
+    bool operator==(const NodeHandle& o) const { return index == o.index && generation == o.generation; }
+    bool operator!=(const NodeHandle& o) const { return !(*this == o); }
+};
+
+template<typename T>
+class SlotMap {
+    struct Slot {
+        T value{};
+        uint32_t generation = 1;
+        bool alive = false;
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> freeList;
+public:
+    NodeHandle insert(const T& value) {
+        uint32_t i;
+        if (!freeList.empty()) { i = freeList.back(); freeList.pop_back(); }
+        else { i = uint32_t(slots.size()); slots.emplace_back(); }
+        slots[i].value = value;
+        slots[i].alive = true;
+        return {i, slots[i].generation};
+    }
+
+    void erase(NodeHandle h) {
+        if (!valid(h)) return;
+        Slot& s = slots[h.index];
+        s.value = T{};
+        s.alive = false;
+        if (++s.generation == 0) s.generation = 1;
+        freeList.push_back(h.index);
+    }
+
+    bool valid(NodeHandle h) const {
+        return h.index < slots.size() && slots[h.index].alive
+            && slots[h.index].generation == h.generation;
+    }
+
+    const T* get(NodeHandle h) const { return valid(h) ? &slots[h.index].value : nullptr; }
+    T*       get(NodeHandle h)       { return valid(h) ? &slots[h.index].value : nullptr; }
+
+    size_t capacity() const { return slots.size(); }
+};
+
+// Per-handle side table for structures that track nodes they hold
+// (partitioner cell/slot locations). Indexed by slot, checked by generation.
+template<typename T>
+class HandleMap {
+    std::vector<std::pair<uint32_t, T>> slots;   // (generation, value)
+public:
+    T* find(NodeHandle h) {
+        if (h.index >= slots.size() || slots[h.index].first != h.generation || h.isNull()) return nullptr;
+        return &slots[h.index].second;
+    }
+    void set(NodeHandle h, const T& value) {
+        if (h.index >= slots.size()) slots.resize(h.index + 1, {0, T{}});
+        slots[h.index] = {h.generation, value};
+    }
+    void erase(NodeHandle h) {
+        if (find(h)) slots[h.index] = {0, T{}};
+    }
+    void clear() { slots.clear(); }
+};
+
+// Registry of live SceneNodes. Nodes register themselves on construction;
+// mutation happens on the thread that edits the scene, lookups are read-only
+// and may run from several culling threads.
+inline SlotMap<SceneNode*>& nodeRegistry() {
+    static SlotMap<SceneNode*> registry;
+    return registry;
+}
+
+// ---------------------------------------------
+// Partitioning interface
+
+class FrustumCuller;
+
+// Runtime-switchable interface. The partitioners themselves are plain final
+// classes with the same members; PartitionerAdapter wraps one behind this
+// interface, while Scene<P> calls it directly so hot paths can inline.
+class PartitioningStrategy {
+public:
+    virtual void insert(NodeHandle node) = 0;
+    // Re-reads the node's world bounds; inserts it if it is not held yet.
+    virtual void update(NodeHandle node) = 0;
+    // Drops the node. Works with stale handles of nodes already destroyed.
+    virtual void remove(NodeHandle node) = 0;
+    virtual void clear() = 0;
+    // Finishes work deferred by the edits above: sorting, batched builds,
+    // refits. query() never modifies the partitioner, so several threads may
+    // query one at once; it stays correct without prepare(), only slower.
+    virtual void prepare() = 0;
+    // Appends the nodes whose world bounds may intersect the frustum.
+    virtual void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const = 0;
+    virtual ~PartitioningStrategy() = default;
+
+    void insert(const SceneNodePtr& node);
+};
+
+// What most partitioners store per node.
+struct PartitionEntry {
+    NodeHandle node;
+    BoundingBox bounds;
+};
+
+// Swap-and-pop erase of list[loc.slot] for partitioners that track where
+// each node lives: the last entry fills the gap under the same location.
+// Returns true if an entry was moved.
+template <typename Entry, typename Location>
+bool swapErase(std::vector<Entry>& list, HandleMap<Location>& locations, const Location& loc) {
+    bool moved = loc.slot + 1 != list.size();
+    if (moved) {
+        list[loc.slot] = list.back();
+        locations.set(list[loc.slot].node, loc);
+    }
+    list.pop_back();
+    return moved;
+}
+
+// ---------------------------------------------
+// Level of Detail (LOD)
+
+struct LODLevel {
+    float distanceThreshold;
+    Symbol meshName;
+};
+
+class LOD {
+public:
+    std::pmr::vector<LODLevel> levels;
+
+    explicit LOD(std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+        : levels(mr) {}
+
+    void addLevel(float distance, const std::string& mesh) { addLevel(distance, Symbol(mesh)); }
+    void addLevel(float distance, Symbol mesh) {
+        levels.push_back({distance, mesh});
+        std::sort(levels.begin(), levels.end(),
+            [](auto& a, auto& b){ return a.distanceThreshold < b.distanceThreshold; });
+    }
+
+    Symbol getMesh(float distance) const {
+        for (auto& lvl : levels)
+            if (distance < lvl.distanceThreshold) return lvl.meshName;
+        return levels.empty() ? Symbol() : levels.back().meshName;
+    }
+};
+
+// ---------------------------------------------
+// Name index
+//
+// Hash index from node name to every attached node carrying it, kept current
+// by SceneNode::addChild/removeChild. Duplicate names are allowed: find()
+// returns the first match in pre-order, findAll() returns all of them in that
+// order and findPath() disambiguates with an absolute path like
+// "Root/Car/Wheel". Subtrees added after attach() rank after the nodes
+// already indexed, in their own pre-order.
+
+class NameIndex {
+    // Per name, nodes keyed by indexing order; each node keeps its key so
+    // removal does not scan the other nodes sharing its name.
+    std::unordered_map<Symbol, std::map<uint64_t, NodeHandle>> byName;
+    uint64_t nextKey = 0;
+public:
+    void attach(const SceneNodePtr& root);
+    void addSubtree(SceneNode& node);
+    void removeSubtree(SceneNode& node);
+
+    SceneNode* find(const std::string& name) const;
+    std::vector<SceneNode*> findAll(const std::string& name) const;
+    SceneNode* findPath(const std::string& path) const;
+
+    // Path lookup when the key contains '/', plain name lookup otherwise.
+    SceneNode* lookup(const std::string& key) const {
+        return key.find('/') != std::string::npos ? findPath(key) : find(key);
+    }
+};
+
+// ---------------------------------------------
+// Scene Node
+
+class LinearHierarchy;
+
+class SceneNode : public std::enable_shared_from_this<SceneNode> {
+    friend class LinearHierarchy;
+public:
+    Symbol name;
+    Transform transform;
+    std::weak_ptr<SceneNode> parent;
+    std::pmr::vector<SceneNodePtr> children;
+    BoundingBox boundingBox;
+    LOD lod;
+    bool visible;
+    const NodeHandle handle;
+    NameIndex* index = nullptr;   // set while attached to an indexed scene
+    uint64_t indexKey = 0;        // this node's key in index's bucket for name
+
+    SceneNode(const std::string& n) : SceneNode(Symbol(n)) {}
+    SceneNode(Symbol n, std::pmr::memory_resource* mr = std::pmr::get_default_resource())
+        : name(n), children(mr), boundingBox({{-1,-1,-1},{1,1,1}}), lod(mr), visible(true),
+          handle(nodeRegistry().insert(this)),
+          worldMatrix(1.0f) {}
+    ~SceneNode() { nodeRegistry().erase(handle); }
+
+    SceneNode(const SceneNode&) = delete;
+    SceneNode& operator=(const SceneNode&) = delete;
+
+    static SceneNode* fromHandle(NodeHandle h) {
+        auto* n = nodeRegistry().get(h);
+        return n ? *n : nullptr;
+    }
+
+    void addChild(const SceneNodePtr& child) {
+        child->parent = shared_from_this();
+        ++child->parentVersion;
+        children.push_back(child);
+        if (index) index->addSubtree(*child);
+    }
+    void removeChild(const SceneNodePtr& child) {
+        if (child->index && child->parent.lock().get() == this)
+            child->index->removeSubtree(*child);
+        children.erase(
+            std::remove(children.begin(), children.end(), child),
+            children.end()
+        );
+        if (child->parent.lock().get() == this) {
+            child->parent.reset();
+            ++child->parentVersion;
+        }
+    }
+
+    // Cached result of the last updateWorldMatrix() pass.
+    const mat4& getWorldMatrix() const { return worldMatrix; }
+    BoundingBox worldBounds() const { return transformBox(boundingBox, worldMatrix); }
+
+    // Changes whenever the world matrix may need recomputing: a Transform
+    // setter ran or the node changed parent. updateWorldMatrix() and every
+    // LinearHierarchy compare it against their own copy, so neither can
+    // swallow a change the other has not seen yet.
+    uint64_t changeStamp() const { return (uint64_t(parentVersion) << 32) | transform.getVersion(); }
+
+    // Top-down refresh of the cached world matrices. Only subtrees below a
+    // changed Transform (or a re-parented node) are recomputed; clean nodes
+    // cost a stamp compare.
+    void updateWorldMatrix(bool force = false) {
+        auto p = parent.lock();
+        updateWorldMatrix(p ? p->worldMatrix : mat4(1.0f), force);
+    }
+
+    void draw(int depth = 0) const {
+        for (int i = 0; i < depth; ++i) std::cout << "  ";
+        std::cout << name << " [Visible: " << visible << "]\n";
+        for (auto& c : children) c->draw(depth + 1);
+    }
+
+private:
+    mat4 worldMatrix;
+    uint32_t parentVersion = 0;             // bumped on every re-parent
+    uint64_t worldStamp = ~uint64_t(0);     // changeStamp() behind worldMatrix
+
+    void updateWorldMatrix(const mat4& parentWorld, bool force) {
+        uint64_t stamp = changeStamp();
+        force = force || worldStamp != stamp;
+        if (force) {
+            worldMatrix = parentWorld * transform.getMatrix();
+            worldStamp = stamp;
+        }
+        for (auto& c : children) c->updateWorldMatrix(worldMatrix, force);
+    }
+};
+
+// ---------------------------------------------
+// Scene memory pool
+//
+// Owns the memory of one scene: nodes (with their shared_ptr control
+// blocks), children vectors and LOD vectors are carved out of a pooled
+// resource that grabs large chunks from the heap, so loading a big scene
+// costs a handful of mallocs and dropping the pool returns them in one go.
+// Not thread-safe; every node made here must be destroyed before the pool.
+
+class ScenePool {
+    std::pmr::unsynchronized_pool_resource pool;
+public:
+    ScenePool() = default;
+    ScenePool(const ScenePool&) = delete;
+    ScenePool& operator=(const ScenePool&) = delete;
+
+    std::pmr::memory_resource* resource() { return &pool; }
+
+    SceneNodePtr makeNode(Symbol name) {
+        std::pmr::polymorphic_allocator<SceneNode> alloc(&pool);
+        return std::allocate_shared<SceneNode>(alloc, name, &pool);
+    }
+};
+
+inline void PartitioningStrategy::insert(const SceneNodePtr& node) {
+    insert(node->handle);
+}
+
+inline void NameIndex::attach(const SceneNodePtr& root) {
+    byName.clear();
+    nextKey = 0;
+    if (root) addSubtree(*root);
+}
+
+// Children are pushed last-first so they are indexed in pre-order, the same
+// order addChild() calls would have produced.
+inline void NameIndex::addSubtree(SceneNode& node) {
+    std::vector<SceneNode*> stack{&node};
+    while (!stack.empty()) {
+        SceneNode* n = stack.back();
+        stack.pop_back();
+        n->index = this;
+        n->indexKey = nextKey++;
+        auto& bucket = byName[n->name];
+        bucket.emplace_hint(bucket.end(), n->indexKey, n->handle);
+        for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+            stack.push_back(it->get());
+    }
+}
+
+inline void NameIndex::removeSubtree(SceneNode& node) {
+    std::vector<SceneNode*> stack{&node};
+    while (!stack.empty()) {
+        SceneNode* n = stack.back();
+        stack.pop_back();
+        n->index = nullptr;
+        auto it = byName.find(n->name);
+        if (it != byName.end()) {
+            it->second.erase(n->indexKey);
+            if (it->second.empty()) byName.erase(it);
+        }
+        for (auto& c : n->children) stack.push_back(c.get());
+    }
+}
+
+inline SceneNode* NameIndex::find(const std::string& name) const {
+    auto it = byName.find(Symbol::lookup(name));
+    if (it == byName.end()) return nullptr;
+    for (auto& [key, h] : it->second)
+        if (auto* n = SceneNode::fromHandle(h)) return n;
+    return nullptr;
+}
+
+inline std::vector<SceneNode*> NameIndex::findAll(const std::string& name) const {
+    std::vector<SceneNode*> out;
+    auto it = byName.find(Symbol::lookup(name));
+    if (it == byName.end()) return out;
+    for (auto& [key, h] : it->second)
+        if (auto* n = SceneNode::fromHandle(h)) out.push_back(n);
+    return out;
+}
+
+inline SceneNode* NameIndex::findPath(const std::string& path) const {
+    std::vector<Symbol> parts;
+    std::stringstream ss(path);
+    for (std::string part; std::getline(ss, part, '/');) {
+        if (part.empty()) continue;
+        Symbol sym = Symbol::lookup(part);
+        if (sym.empty()) return nullptr;
+        parts.push_back(sym);
+    }
+    if (parts.empty()) return nullptr;
+
+    auto it = byName.find(parts.back());
+    if (it == byName.end()) return nullptr;
+    for (auto& [key, h] : it->second) {
+        SceneNode* candidate = SceneNode::fromHandle(h);
+        if (!candidate) continue;
+        SceneNode* n = candidate;
+        size_t i = parts.size() - 1;
+        while (i > 0) {
+            auto p = n->parent.lock();
+            if (!p || p->name != parts[i - 1]) break;
+            n = p.get();
+            --i;
+        }
+        if (i == 0 && !n->parent.lock()) return candidate;
+    }
+    return nullptr;
+}
+
+// ---------------------------------------------
+// Job system
+//
+// Work-stealing scheduler: one deque per worker plus one shared by outside
+// threads. Owners push and pop at the back, idle threads steal from the
+// front of other deques. JobGroup::wait() makes the caller run jobs too, so
+// with zero workers everything simply executes serially on the caller.
+
+class JobSystem;
+
+class JobGroup {
+    friend class JobSystem;
+    std::atomic<int> pending{0};
+public:
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+class JobSystem {
+    struct Job {
+        std::function<void()> fn;
+        JobGroup* group = nullptr;
+    };
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues;   // [0] outside threads, [k+1] worker k
+    std::vector<std::thread> workers;
+    std::atomic<bool> stopping{false};
+    std::atomic<int> queued{0};
+    std::atomic<int> sleepers{0};   // workers inside wake.wait()
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+
+    static thread_local JobSystem* tlsOwner;
+    static thread_local size_t tlsQueue;
+
+    size_t selfQueue() const { return tlsOwner == this ? tlsQueue : 0; }
+
+    bool pop(size_t q, Job& job) {
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        auto& jobs = queues[q]->jobs;
+        if (jobs.empty()) return false;
+        job = std::move(jobs.back());
+        jobs.pop_back();
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool steal(size_t self, Job& job) {
+        for (size_t k = 1; k < queues.size(); ++k) {
+            size_t q = (self + k) % queues.size();
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            auto& jobs = queues[q]->jobs;
+            if (jobs.empty()) continue;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    bool runOne(size_t self) {
+        Job job;
+        if (!pop(self, job) && !steal(self, job)) return false;
+        job.fn();
+        job.group->pending.fetch_sub(1, std::memory_order_acq_rel);
+        return true;
+    }
+
+    void workerLoop(size_t self) {
+        tlsOwner = this;
+        tlsQueue = self;
+        while (!stopping.load(std::memory_order_acquire)) {
+            if (runOne(self)) continue;
+            // Announce the sleep before re-checking queued; spawn() bumps
+            // queued before reading sleepers, so one of the two sees the other.
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [&]{ return stopping.load() || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+        }
+    }
+
+public:
+    explicit JobSystem(unsigned workerCount = std::max(1u, std::thread::hardware_concurrency()) - 1) {
+        for (unsigned i = 0; i <= workerCount; ++i)
+            queues.push_back(std::make_unique<Queue>());
+        for (unsigned i = 0; i < workerCount; ++i)
+            workers.emplace_back([this, i]{ workerLoop(i + 1); });
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& w : workers) w.join();
+    }
+
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Threads that execute jobs, counting the one that waits.
+    size_t threadCount() const { return workers.size() + 1; }
+
+    void spawn(JobGroup& group, std::function<void()> fn) {
+        group.pending.fetch_add(1, std::memory_order_relaxed);
+        size_t q = selfQueue();
+        {
+            std::lock_guard<std::mutex> lock(queues[q]->mutex);
+            queues[q]->jobs.push_back({std::move(fn), &group});
+        }
+        queued.fetch_add(1);
+        if (sleepers.load() == 0) return;   // busy workers find the job on their own
+        { std::lock_guard<std::mutex> lock(sleepMutex); }
+        wake.notify_one();
+    }
+
+    void wait(JobGroup& group) {
+        size_t self = selfQueue();
+        while (!group.done())
+            if (!runOne(self)) std::this_thread::yield();
+    }
+
+    // Runs fn(begin, end) over [0, count) in chunks of at least grain items.
+    template<typename F>
+    void parallelFor(size_t count, size_t grain, F fn) {
+        size_t chunks = std::min(threadCount() * 4, (count + grain - 1) / std::max<size_t>(grain, 1));
+        if (chunks <= 1) { if (count) fn(size_t(0), count); return; }
+        size_t step = (count + chunks - 1) / chunks;
+        JobGroup group;
+        for (size_t b = 0; b < count; b += step) {
+            size_t e = std::min(count, b + step);
+            spawn(group, [&fn, b, e]{ fn(b, e); });
+        }
+        wait(group);
+    }
+};
+
+inline thread_local JobSystem* JobSystem::tlsOwner = nullptr;
+inline thread_local size_t JobSystem::tlsQueue = 0;
+
+inline JobSystem& jobSystem() {
+    static JobSystem jobs;
+    return jobs;
+}
+
+// ---------------------------------------------
+// Linear hierarchy
+//
+// Flattened pre-order copy of a SceneNode tree: parents always precede their
+// children and every subtree is the contiguous range [i, i + subtreeSize[i]).
+// World matrices become one forward loop over TransformPool arrays and
+// traversals become linear scans. SceneNode stays the editing facade:
+// rebuild() after structural edits, update() once per frame.
+
+class LinearHierarchy {
+public:
+    std::vector<SceneNode*> nodes;        // non-owning, the SceneNode tree owns
+    std::vector<int32_t>    parent;       // -1 for the root
+    std::vector<uint32_t>   subtreeSize;  // including the node itself
+    std::vector<int>        depth;
+    std::vector<uint8_t>    moved;        // world matrix changed in the last update()
+    std::vector<uint64_t>   seenStamp;    // changeStamp() last pulled per node
+    TransformPool           transforms;
+    // World AABB per node as centers and half-extents, for cullBatch().
+    std::vector<float>      centerX, centerY, centerZ;
+    std::vector<float>      extentX, extentY, extentZ;
+    // World AABB enclosing each node's whole subtree.
+    std::vector<BoundingBox> subtreeBounds;
+    uint64_t                revision = 0;   // bumped whenever world bounds change
+
+    size_t size() const { return nodes.size(); }
+    bool empty() const  { return nodes.empty(); }
+
+    void rebuild(const SceneNodePtr& root) {
+        // Nodes that survive the rebuild keep their last-pulled stamp, so a
+        // change made before it still shows up as moved in the next update().
+        std::unordered_map<const SceneNode*, uint64_t> previous;
+        previous.reserve(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) previous.emplace(nodes[i], seenStamp[i]);
+
+        nodes.clear(); parent.clear(); depth.clear(); seenStamp.clear();
+        transforms.clear();
+        if (!root) { subtreeSize.clear(); moved.clear(); return; }
+
+        std::vector<std::pair<SceneNode*, int32_t>> stack{{root.get(), -1}};
+        while (!stack.empty()) {
+            auto [n, p] = stack.back();
+            stack.pop_back();
+            parent.push_back(p);
+            depth.push_back(p < 0 ? 0 : depth[p] + 1);
+            nodes.push_back(n);
+            auto seen = previous.find(n);
+            seenStamp.push_back(seen != previous.end() ? seen->second : ~uint64_t(0));
+            transforms.add(n->transform);
+            int32_t self = int32_t(nodes.size() - 1);
+            for (auto it = n->children.rbegin(); it != n->children.rend(); ++it)
+                stack.push_back({it->get(), self});
+        }
+
+        subtreeSize.assign(nodes.size(), 1);
+        for (size_t i = nodes.size(); i-- > 1;)
+            subtreeSize[parent[i]] += subtreeSize[i];
+        moved.assign(nodes.size(), 0);
+
+        // Seed from the facade caches so a structural edit only reports the
+        // nodes that were actually added or re-parented as moved.
+        transforms.composeLocal();
+        for (auto* v : {&centerX, &centerY, &centerZ, &extentX, &extentY, &extentZ})
+            v->resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            transforms.world[i] = nodes[i]->worldMatrix;
+            storeBounds(i);
+        }
+        gatherSubtreeBounds();
+    }
+
+    // Pulls changed Transforms from the facade, recomposes their local
+    // matrices and propagates world matrices parent-first with no recursion.
+    // With a JobSystem and enough nodes, both passes are split into range
+    // and subtree jobs; small scenes stay on the calling thread.
+    void update(bool force = false, JobSystem* jobs = nullptr) {
+        size_t n = size();
+        if (n == 0) return;
+
+        if (!jobs || jobs->threadCount() == 1 || n < 2 * parallelGrain) {
+            if (pullLocals(0, n, force)) {
+                propagate(0, n);
+                gatherSubtreeBounds();
+            }
+            return;
+        }
+
+        std::atomic<bool> anyMoved{false};
+        jobs->parallelFor(n, parallelGrain, [&](size_t b, size_t e) {
+            if (pullLocals(b, e, force)) anyMoved.store(true, std::memory_order_relaxed);
+        });
+        if (!anyMoved.load()) return;
+
+        JobGroup group;
+        propagate(0, 1);
+        spawnChildren(*jobs, group, 0);
+        jobs->wait(group);
+        gatherSubtreeBounds();
+    }
+
+    size_t parallelGrain = 4096;   // nodes per job
+
+    void draw() const {
+        for (size_t i = 0; i < size(); ++i) {
+            for (int d = 0; d < depth[i]; ++d) std::cout << "  ";
+            std::cout << nodes[i]->name << " [Visible: " << nodes[i]->visible << "]\n";
+        }
+    }
+
+private:
+    // Refreshes moved[] and local matrices for [begin, end); true if any moved.
+    bool pullLocals(size_t begin, size_t end, bool force) {
+        size_t dirtyCount = 0;
+        for (size_t i = begin; i < end; ++i) {
+            uint64_t stamp = nodes[i]->changeStamp();
+            moved[i] = force || seenStamp[i] != stamp;
+            if (!moved[i]) continue;
+            seenStamp[i] = stamp;
+            transforms.set(uint32_t(i), nodes[i]->transform);
+            ++dirtyCount;
+        }
+        if (dirtyCount * 4 >= end - begin) transforms.composeLocal(begin, end);
+        else for (size_t i = begin; i < end; ++i) if (moved[i]) transforms.composeScalar(i);
+        return dirtyCount > 0;
+    }
+
+    // Forward world-matrix pass over [begin, end); parents outside the range
+    // must already be final.
+    void propagate(size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            int32_t p = parent[i];
+            if (p >= 0) moved[i] = moved[i] | moved[p];
+            if (!moved[i]) continue;
+            transforms.world[i] = p < 0 ? transforms.local[i]
+                                        : transforms.world[p] * transforms.local[i];
+            nodes[i]->worldMatrix = transforms.world[i];
+            nodes[i]->worldStamp = seenStamp[i];
+            storeBounds(i);
+        }
+    }
+
+    // Children follow their parent, so one reverse pass folds every subtree
+    // into its root.
+    void gatherSubtreeBounds() {
+        ++revision;
+        size_t n = size();
+        subtreeBounds.resize(n);
+        for (size_t i = 0; i < n; ++i) {
+            vec3 c(centerX[i], centerY[i], centerZ[i]), e(extentX[i], extentY[i], extentZ[i]);
+            subtreeBounds[i] = {c - e, c + e};
+        }
+        for (size_t i = n; i-- > 1;) {
+            subtreeBounds[parent[i]].expand(subtreeBounds[i]);
+        }
+    }
+
+    void storeBounds(size_t i) {
+        BoundingBox b = transformBox(nodes[i]->boundingBox, transforms.world[i]);
+        vec3 c = b.center(), e = b.extents();
+        centerX[i] = c.x; centerY[i] = c.y; centerZ[i] = c.z;
+        extentX[i] = e.x; extentY[i] = e.y; extentZ[i] = e.z;
+    }
+
+    // Children of a finished node are consecutive subtrees. Large ones are
+    // descended into as their own jobs; runs of small ones are batched into a
+    // single contiguous range job of about parallelGrain nodes.
+    void spawnChildren(JobSystem& jobs, JobGroup& group, size_t node) {
+        size_t end = node + subtreeSize[node];
+        size_t runBegin = node + 1;
+        for (size_t c = node + 1; c < end; c += subtreeSize[c]) {
+            if (subtreeSize[c] >= parallelGrain) {
+                if (runBegin < c)
+                    jobs.spawn(group, [this, runBegin, c]{ propagate(runBegin, c); });
+                jobs.spawn(group, [this, &jobs, &group, c]{
+                    propagate(c, c + 1);
+                    spawnChildren(jobs, group, c);
+                });
+                runBegin = c + subtreeSize[c];
+            } else if (c + subtreeSize[c] - runBegin >= parallelGrain) {
+                size_t runEnd = c + subtreeSize[c];
+                jobs.spawn(group, [this, runBegin, runEnd]{ propagate(runBegin, runEnd); });
+                runBegin = runEnd;
+            }
+        }
+        if (runBegin < end)
+            jobs.spawn(group, [this, runBegin, end]{ propagate(runBegin, end); });
+    }
+};
+
+// ---------------------------------------------
+// Frustum Culling
+
+// Sets bits [begin, end) of a bitmask stored 64 entries per word.
+inline void setBitRange(std::vector<uint64_t>& bits, size_t begin, size_t end) {
+    for (; begin < end && (begin & 63); ++begin) bits[begin >> 6] |= uint64_t(1) << (begin & 63);
+    for (; begin + 64 <= end; begin += 64) bits[begin >> 6] = ~uint64_t(0);
+    for (; begin < end; ++begin) bits[begin >> 6] |= uint64_t(1) << (begin & 63);
+}
+
+class FrustumCuller {
+public:
+    struct CoherenceStats {
+        size_t tested = 0;        // nodes tested by the last cullCoherent() or cullCandidates()
+        size_t cachedTests = 0;   // of those, nodes with a remembered plane
+        size_t cachedHits = 0;    // rejected by that plane alone
+        bool reused = false;      // previous result returned unchanged
+
+        float hitRate() const { return cachedTests ? float(cachedHits) / float(cachedTests) : 0.0f; }
+    };
+
+    // Largest change of any view-projection element for which cullCoherent()
+    // still returns the previous result when the hierarchy is unchanged.
+    // Anything above 0 trades exactness for speed; below 0 disables reuse.
+    float reuseEpsilon = 0.0f;
+
+private:
+    static constexpr uint8_t noPlane = 0xFF;
+
+    std::array<vec4,6> planes;
+    std::array<vec3,8> cornerPoints;
+    mat4 viewProj;
+
+    // cullCoherent() state
+    std::vector<uint8_t> lastPlane;   // per hierarchy index, the plane that last rejected it
+    std::vector<uint8_t> handlePlane; // cullCandidates(): the same, per handle slot
+    std::vector<uint64_t> lastVisible;
+    mat4 lastViewProj{0.0f};
+    const LinearHierarchy* lastHierarchy = nullptr;
+    uint64_t lastRevision = 0;
+    CoherenceStats stats;
+
+    void extractPlanes(const mat4& m) {
+        planes[0] = glm::row(m,3) + glm::row(m,0);
+        planes[1] = glm::row(m,3) - glm::row(m,0);
+        planes[2] = glm::row(m,3) + glm::row(m,1);
+        planes[3] = glm::row(m,3) - glm::row(m,1);
+        planes[4] = glm::row(m,3) + glm::row(m,2);
+        planes[5] = glm::row(m,3) - glm::row(m,2);
+        for (auto& p : planes) {
+            float l = glm::length(glm::vec3(p));
+            p /= l;
+        }
+        for (int i = 0; i < 8; ++i)
+            cornerPoints[i] = intersect(planes[i & 1], planes[2 + ((i >> 1) & 1)], planes[4 + (i >> 2)]);
+    }
+
+    static vec3 intersect(const vec4& a, const vec4& b, const vec4& c) {
+        vec3 na(a), nb(b), nc(c);
+        vec3 bc = glm::cross(nb, nc);
+        return (bc * -a.w + glm::cross(nc, na) * -b.w + glm::cross(na, nb) * -c.w) / glm::dot(na, bc);
+    }
+
+public:
+    enum class Containment { Outside, Intersects, Inside };
+
+    FrustumCuller(const mat4& projView) {
+        setViewProjection(projView);
+    }
+
+    // Re-aims the culler; per-node coherence state is kept across calls.
+    void setViewProjection(const mat4& projView) {
+        viewProj = projView;
+        extractPlanes(projView);
+    }
+
+    const CoherenceStats& coherenceStats() const { return stats; }
+
+    // World-space frustum corners; bit 0 picks right, bit 1 top, bit 2 far.
+    const std::array<vec3,8>& corners() const { return cornerPoints; }
+    // Normalized planes, inside where dot(xyz, p) + w >= 0.
+    const std::array<vec4,6>& getPlanes() const { return planes; }
+
+    // Conservative test of a world-space AABB: one dot plus a radius
+    // projection per plane.
+    Containment classify(const BoundingBox& worldBox) const {
+        vec3 c = worldBox.center(), e = worldBox.extents();
+        Containment result = Containment::Inside;
+        for (auto& plane : planes) {
+            vec3 n(plane);
+            float d = glm::dot(n, c) + plane.w;
+            float r = glm::dot(glm::abs(n), e);
+            if (d + r < 0) return Containment::Outside;
+            if (d - r < 0) result = Containment::Intersects;
+        }
+        return result;
+    }
+
+    // Tests count world AABBs given as separate center and half-extent
+    // arrays; bit i of visible (64 boxes per word) is set unless box i lies
+    // fully behind a plane. Same verdict as classify() != Outside, 8 (AVX2)
+    // or 4 (SSE) boxes at a time; all paths use the same unfused multiplies
+    // and adds, so unless the whole file is built with FMA contraction
+    // (e.g. -mfma) a box's verdict does not depend on which path tested it.
+    void cullBatch(const float* cx, const float* cy, const float* cz,
+                   const float* ex, const float* ey, const float* ez,
+                   size_t count, uint64_t* visible) const {
+        std::fill(visible, visible + (count + 63) / 64, uint64_t(0));
+        size_t i = 0;
+#if defined(SG_AVX2)
+        if (cpuHasAVX2()) i = cullBatchAVX2(cx, cy, cz, ex, ey, ez, count, visible);
+#endif
+#if defined(SG_SSE)
+        i = cullBatchSSE(cx, cy, cz, ex, ey, ez, i, count, visible);
+#endif
+        for (; i < count; ++i) {
+            bool inside = true;
+            for (auto& plane : planes) {
+                float d = plane.x * cx[i] + plane.y * cy[i] + plane.z * cz[i] + plane.w;
+                float r = std::fabs(plane.x) * ex[i] + std::fabs(plane.y) * ey[i] + std::fabs(plane.z) * ez[i];
+                if (d + r < 0) { inside = false; break; }
+            }
+            if (inside) visible[i >> 6] |= uint64_t(1) << (i & 63);
+        }
+    }
+
+    // Culls every node of the hierarchy by its cached world bounds.
+    void cullBatch(const LinearHierarchy& h, std::vector<uint64_t>& visible) const {
+        visible.resize((h.size() + 63) / 64);
+        cullBatch(h.centerX.data(), h.centerY.data(), h.centerZ.data(),
+                  h.extentX.data(), h.extentY.data(), h.extentZ.data(), h.size(), visible.data());
+    }
+
+    // Top-down cull of the hierarchy, same bitmask layout as cullBatch().
+    // A subtree outside a plane is skipped whole; planes a subtree is fully
+    // in front of are dropped from the mask its descendants test, and once
+    // the mask is empty the whole subtree is accepted without further tests.
+    void cullHierarchy(const LinearHierarchy& h, std::vector<uint64_t>& visible) const {
+        size_t n = h.size();
+        visible.assign((n + 63) / 64, 0);
+        std::vector<std::pair<size_t, uint8_t>> masks;   // (subtree end, planes left)
+        masks.reserve(64);
+        size_t i = 0;
+        while (i < n) {
+            while (!masks.empty() && masks.back().first <= i) masks.pop_back();
+            uint8_t mask = masks.empty() ? 0x3F : masks.back().second;
+            size_t end = i + h.subtreeSize[i];
+
+            const BoundingBox& sb = h.subtreeBounds[i];
+            vec3 c = sb.center(), e = sb.extents();
+            uint8_t inner = mask;
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; ++p) {
+                if (!(mask & (1 << p))) continue;
+                vec3 nrm(planes[p]);
+                float d = glm::dot(nrm, c) + planes[p].w;
+                float r = glm::dot(glm::abs(nrm), e);
+                if (d + r < 0) outside = true;
+                else if (d - r >= 0) inner &= uint8_t(~(1 << p));
+            }
+            if (outside) { i = end; continue; }
+            if (inner == 0) {
+                setBitRange(visible, i, end);
+                i = end;
+                continue;
+            }
+
+            c = vec3(h.centerX[i], h.centerY[i], h.centerZ[i]);
+            e = vec3(h.extentX[i], h.extentY[i], h.extentZ[i]);
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; ++p) {
+                if (!(inner & (1 << p))) continue;
+                vec3 nrm(planes[p]);
+                inside = glm::dot(nrm, c) + planes[p].w + glm::dot(glm::abs(nrm), e) >= 0;
+            }
+            if (inside) visible[i >> 6] |= uint64_t(1) << (i & 63);
+            if (end > i + 1) masks.push_back({end, inner});
+            ++i;
+        }
+    }
+
+    // Per-node cull of the hierarchy with frame-to-frame coherence, same
+    // bitmask layout as cullBatch(). The plane that rejected a node last time
+    // is tested first, since under smooth camera motion it usually rejects it
+    // again. If neither the camera (within reuseEpsilon) nor the hierarchy
+    // changed since the last full pass, that pass's result is returned as is.
+    void cullCoherent(const LinearHierarchy& h, std::vector<uint64_t>& visible) {
+        size_t n = h.size();
+        stats = CoherenceStats();
+        if (reuseEpsilon >= 0 && lastHierarchy == &h && lastRevision == h.revision &&
+            maxDifference(viewProj, lastViewProj) <= reuseEpsilon) {
+            visible = lastVisible;
+            stats.reused = true;
+            return;
+        }
+
+        if (lastHierarchy != &h || lastPlane.size() != n) lastPlane.assign(n, noPlane);
+        visible.assign((n + 63) / 64, 0);
+        stats.tested = n;
+        for (size_t i = 0; i < n; ++i) {
+            vec3 c(h.centerX[i], h.centerY[i], h.centerZ[i]);
+            vec3 e(h.extentX[i], h.extentY[i], h.extentZ[i]);
+            uint8_t cached = lastPlane[i];
+            if (cached != noPlane) {
+                ++stats.cachedTests;
+                if (outside(planes[cached], c, e)) { ++stats.cachedHits; continue; }
+            }
+            uint8_t rejected = noPlane;
+            for (uint8_t p = 0; p < 6; ++p)
+                if (p != cached && outside(planes[p], c, e)) { rejected = p; break; }
+            lastPlane[i] = rejected;
+            if (rejected == noPlane) visible[i >> 6] |= uint64_t(1) << (i & 63);
+        }
+
+        lastVisible = visible;
+        lastViewProj = viewProj;
+        lastHierarchy = &h;
+        lastRevision = h.revision;
+    }
+
+    // Exact isVisible() test of partitioner candidates with the plane cache
+    // of cullCoherent(), keyed by handle slot instead of hierarchy index.
+    // Keeps the visible handles in order and sets each node's visible flag.
+    // The cached plane is only tried first, so a recycled slot costs at most
+    // one extra plane test.
+    void cullCandidates(std::vector<NodeHandle>& candidates) {
+        stats = CoherenceStats();
+        stats.tested = candidates.size();
+        size_t kept = 0;
+        for (NodeHandle h : candidates) {
+            SceneNode* node = SceneNode::fromHandle(h);
+            if (!node) continue;
+            if (h.index >= handlePlane.size()) handlePlane.resize(h.index + 1, noPlane);
+            uint8_t cached = handlePlane[h.index];
+            if (cached != noPlane) ++stats.cachedTests;
+            uint8_t rejected = rejectingPlane(*node, cached);
+            if (cached != noPlane && rejected == cached) ++stats.cachedHits;
+            handlePlane[h.index] = rejected;
+            node->visible = rejected == noPlane;
+            if (node->visible) candidates[kept++] = h;
+        }
+        candidates.resize(kept);
+    }
+
+    bool isVisible(const SceneNodePtr& node) const { return isVisible(*node); }
+
+    bool isVisible(NodeHandle h) const {
+        SceneNode* node = SceneNode::fromHandle(h);
+        return node && isVisible(*node);
+    }
+
+    bool isVisible(SceneNode& node) const {
+        node.visible = rejectingPlane(node, noPlane) == noPlane;
+        return node.visible;
+    }
+
+private:
+    // Same answer as testing the 8 transformed corners against each plane,
+    // without transforming them: the local box becomes a world center and
+    // three scaled world axes, so each plane costs one dot for the center
+    // plus the projected radius. Tests plane `first` before the others and
+    // returns the one that rejects the node, or noPlane.
+    uint8_t rejectingPlane(const SceneNode& node, uint8_t first) const {
+        const mat4& wm = node.getWorldMatrix();
+        const BoundingBox& bb = node.boundingBox;
+        vec3 e = bb.extents();
+        vec3 center = vec3(wm * vec4(bb.center(), 1.0f));
+        vec3 ax = vec3(wm[0]) * e.x, ay = vec3(wm[1]) * e.y, az = vec3(wm[2]) * e.z;
+        auto behind = [&](const vec4& plane) {
+            vec3 n(plane);
+            float d = glm::dot(n, center) + plane.w;
+            float r = std::fabs(glm::dot(n, ax)) + std::fabs(glm::dot(n, ay)) + std::fabs(glm::dot(n, az));
+            return d + r < 0;
+        };
+        if (first != noPlane && behind(planes[first])) return first;
+        for (uint8_t p = 0; p < 6; ++p)
+            if (p != first && behind(planes[p])) return p;
+        return noPlane;
+    }
+
+    static bool outside(const vec4& plane, const vec3& c, const vec3& e) {
+        vec3 n(plane);
+        return glm::dot(n, c) + plane.w + glm::dot(glm::abs(n), e) < 0;
+    }
+
+    static float maxDifference(const mat4& a, const mat4& b) {
+        float d = 0;
+        for (int i = 0; i < 4; ++i)
+            for (int j = 0; j < 4; ++j) d = std::max(d, std::fabs(a[i][j] - b[i][j]));
+        return d;
+    }
+
+#if defined(SG_SSE)
+    // Starts at begin, which must be a multiple of 4; returns where it stopped.
+    size_t cullBatchSSE(const float* cx, const float* cy, const float* cz,
+                        const float* ex, const float* ey, const float* ez,
+                        size_t begin, size_t count, uint64_t* visible) const {
+        const __m128 signMask = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+        __m128 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], nw[6];
+        for (int p = 0; p < 6; ++p) {
+            nx[p] = _mm_set1_ps(planes[p].x); ax[p] = _mm_andnot_ps(signMask, nx[p]);
+            ny[p] = _mm_set1_ps(planes[p].y); ay[p] = _mm_andnot_ps(signMask, ny[p]);
+            nz[p] = _mm_set1_ps(planes[p].z); az[p] = _mm_andnot_ps(signMask, nz[p]);
+            nw[p] = _mm_set1_ps(planes[p].w);
+        }
+        size_t i = begin;
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+            __m128 u = _mm_loadu_ps(ex + i), v = _mm_loadu_ps(ey + i), w = _mm_loadu_ps(ez + i);
+            __m128 outside = zero;
+            for (int p = 0; p < 6; ++p) {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx[p], x), _mm_mul_ps(ny[p], y)),
+                                                 _mm_mul_ps(nz[p], z)), nw[p]);
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ax[p], u), _mm_mul_ps(ay[p], v)),
+                                      _mm_mul_ps(az[p], w));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(d, r), zero));
+            }
+            uint64_t bits = uint64_t(~_mm_movemask_ps(outside) & 0xF);
+            visible[i >> 6] |= bits << (i & 63);
+        }
+        return i;
+    }
+#endif
+
+#if defined(SG_AVX2)
+    SG_TARGET_AVX2 size_t cullBatchAVX2(const float* cx, const float* cy, const float* cz,
+                                        const float* ex, const float* ey, const float* ez,
+                                        size_t count, uint64_t* visible) const {
+        const __m256 signMask = _mm256_set1_ps(-0.0f), zero = _mm256_setzero_ps();
+        __m256 nx[6], ny[6], nz[6], ax[6], ay[6], az[6], nw[6];
+        for (int p = 0; p < 6; ++p) {
+            nx[p] = _mm256_set1_ps(planes[p].x); ax[p] = _mm256_andnot_ps(signMask, nx[p]);
+            ny[p] = _mm256_set1_ps(planes[p].y); ay[p] = _mm256_andnot_ps(signMask, ny[p]);
+            nz[p] = _mm256_set1_ps(planes[p].z); az[p] = _mm256_andnot_ps(signMask, nz[p]);
+            nw[p] = _mm256_set1_ps(planes[p].w);
+        }
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 x = _mm256_loadu_ps(cx + i), y = _mm256_loadu_ps(cy + i), z = _mm256_loadu_ps(cz + i);
+            __m256 u = _mm256_loadu_ps(ex + i), v = _mm256_loadu_ps(ey + i), w = _mm256_loadu_ps(ez + i);
+            __m256 outside = zero;
+            for (int p = 0; p < 6; ++p) {
+                __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx[p], x),
+                                                                     _mm256_mul_ps(ny[p], y)),
+                                                       _mm256_mul_ps(nz[p], z)), nw[p]);
+                __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax[p], u), _mm256_mul_ps(ay[p], v)),
+                                         _mm256_mul_ps(az[p], w));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_LT_OQ));
+            }
+            uint64_t bits = uint64_t(~_mm256_movemask_ps(outside) & 0xFF);
+            visible[i >> 6] |= bits << (i & 63);
+        }
+        return i;
+    }
+#endif
+};
+
+// Culls one hierarchy for several view-projections (main camera, shadow
+// cascades, split-screen views) in a single top-down pass: each node's
+// subtree and own bounds are loaded once and tested against every view
+// still undecided for it. Per view, a node carries the same inherited plane
+// mask as in FrustumCuller::cullHierarchy(); a view stops costing anything
+// for a subtree once it is outside or fully inside it.
+class MultiFrustumCuller {
+    std::vector<std::array<vec4,6>> views;   // at most maxViews
+
+public:
+    MultiFrustumCuller() = default;
+    explicit MultiFrustumCuller(const std::vector<mat4>& viewProjs) { setViewProjections(viewProjs); }
+
+    void setViewProjections(const std::vector<mat4>& viewProjs) {
+        views.clear();
+        for (auto& m : viewProjs) addView(m);
+    }
+    static constexpr size_t maxViews = 64;   // one bit per view in the traversal
+
+    void addView(const mat4& viewProj) {
+        if (views.size() < maxViews) views.push_back(FrustumCuller(viewProj).getPlanes());
+    }
+    size_t viewCount() const { return views.size(); }
+
+    // visible[v] receives the bitmask for view v, laid out as in cullBatch().
+    void cull(const LinearHierarchy& h, std::vector<std::vector<uint64_t>>& visible) const {
+        size_t n = h.size(), viewsN = views.size();
+        visible.resize(viewsN);
+        for (auto& bits : visible) bits.assign((n + 63) / 64, 0);
+        if (viewsN == 0) return;
+
+        // Per open ancestor: its subtree end, the views still undecided in
+        // it, and one plane mask per view.
+        struct Level {
+            size_t end;
+            uint64_t pending;
+        };
+        std::vector<Level> levels{{n, viewsN == 64 ? ~uint64_t(0) : (uint64_t(1) << viewsN) - 1}};
+        std::vector<uint8_t> masks(2 * viewsN, 0x3F);
+        size_t i = 0;
+        while (i < n) {
+            while (levels.back().end <= i) levels.pop_back();
+            size_t depth = levels.size();
+            if (masks.size() < (depth + 1) * viewsN) masks.resize((depth + 1) * viewsN);
+            const uint8_t* inherited = &masks[(depth - 1) * viewsN];
+            uint8_t* current = &masks[depth * viewsN];
+            size_t end = i + h.subtreeSize[i];
+            bool leaf = end == i + 1;
+
+            vec3 c, e;
+            if (leaf) {
+                c = vec3(h.centerX[i], h.centerY[i], h.centerZ[i]);
+                e = vec3(h.extentX[i], h.extentY[i], h.extentZ[i]);
+            } else {
+                c = h.subtreeBounds[i].center();
+                e = h.subtreeBounds[i].extents();
+            }
+            uint64_t pending = 0;
+            for (uint64_t views = levels.back().pending; views; views &= views - 1) {
+                size_t v = size_t(countTrailingZeros(views));
+                uint8_t mask = inherited[v];
+                bool outside = false;
+                for (int p = 0; p < 6 && !outside; ++p) {
+                    if (!(mask & (1 << p))) continue;
+                    const vec4& plane = this->views[v][p];
+                    vec3 nrm(plane);
+                    float d = glm::dot(nrm, c) + plane.w;
+                    float r = glm::dot(glm::abs(nrm), e);
+                    if (d + r < 0) outside = true;
+                    else if (d - r >= 0) mask &= uint8_t(~(1 << p));
+                }
+                if (outside) continue;
+                if (mask == 0 || leaf) {
+                    setBitRange(visible[v], i, end);
+                    continue;
+                }
+                current[v] = mask;
+                pending |= uint64_t(1) << v;
+            }
+            if (!pending) { i = end; continue; }
+
+            c = vec3(h.centerX[i], h.centerY[i], h.centerZ[i]);
+            e = vec3(h.extentX[i], h.extentY[i], h.extentZ[i]);
+            for (uint64_t views = pending; views; views &= views - 1) {
+                size_t v = size_t(countTrailingZeros(views));
+                uint8_t mask = current[v];
+                bool inside = true;
+                for (int p = 0; p < 6 && inside; ++p) {
+                    if (!(mask & (1 << p))) continue;
+                    const vec4& plane = this->views[v][p];
+                    vec3 nrm(plane);
+                    inside = glm::dot(nrm, c) + plane.w + glm::dot(glm::abs(nrm), e) >= 0;
+                }
+                if (inside) visible[v][i >> 6] |= uint64_t(1) << (i & 63);
+            }
+            levels.push_back({end, pending});
+            ++i;
+        }
+    }
+
+private:
+    static int countTrailingZeros(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctzll(x);
+#else
+        int n = 0;
+        while (!(x & 1)) { x >>= 1; ++n; }
+        return n;
+#endif
+    }
+};
+
+// ---------------------------------------------
+// Octree partitioning
+
+// Objects are stored in the deepest cell that fully contains their world
+// AABB; objects straddling child boundaries stay at the parent. A leaf
+// splits once it holds more than cellCapacity objects, down to maxDepth.
+// Objects outside the root cube are kept in a separate list. Each node's
+// cell and slot are tracked, so update() and remove() are O(1) unless the
+// node has to move to another cell.
+
+class Octree final {
+    using Entry = PartitionEntry;
+
+    struct Cell {
+        vec3 center;
+        float halfSize;
+        int depth;
+        std::vector<Entry> objects;
+        std::array<std::unique_ptr<Cell>, 8> children;
+
+        Cell(const vec3& c, float hs, int d) : center(c), halfSize(hs), depth(d) {}
+        bool isLeaf() const { return !children[0]; }
+        BoundingBox bounds() const { return BoundingBox::fromCenterExtents(center, vec3(halfSize)); }
+    };
+
+    struct Location {
+        Cell* cell = nullptr;   // nullptr: outside list
+        uint32_t slot = 0;
+    };
+
+    Cell root;
+    std::vector<Entry> outside;
+    HandleMap<Location> locations;
+    size_t cellCapacity;
+    int maxDepth;
+
+public:
+    Octree(const vec3& c, float hs, size_t capacity = 8, int depthLimit = 8)
+        : root(c, hs, 0), cellCapacity(capacity), maxDepth(depthLimit) {}
+
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || locations.find(node)) return;
+        Entry e{node, n->worldBounds()};
+        if (root.bounds().contains(e.bounds)) insert(root, e);
+        else append(nullptr, e);
+    }
+
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        Location* loc = locations.find(node);
+        if (!n || !loc) { remove(node); insert(node); return; }
+        BoundingBox bb = n->worldBounds();
+        if (loc->cell && loc->cell->bounds().contains(bb)) {
+            loc->cell->objects[loc->slot].bounds = bb;
+            return;
+        }
+        remove(node);
+        insert(node);
+    }
+
+    void remove(NodeHandle node) {
+        Location* loc = locations.find(node);
+        if (!loc) return;
+        Location l = *loc;
+        locations.erase(node);
+        swapErase(l.cell ? l.cell->objects : outside, locations, l);
+    }
+
+    void clear() {
+        root.objects.clear();
+        for (auto& ch : root.children) ch.reset();
+        outside.clear();
+        locations.clear();
+    }
+
+    void prepare() {}   // nothing is deferred
+
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        for (auto& e : outside)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+        query(root, culler, out, false);
+    }
+
+private:
+    // Child octant that fully contains box, or -1 if it straddles.
+    static int childIndex(const Cell& cell, const BoundingBox& box) {
+        int i = 0;
+        vec3 bc = box.center();
+        if (bc.x > cell.center.x) i |= 1;
+        if (bc.y > cell.center.y) i |= 2;
+        if (bc.z > cell.center.z) i |= 4;
+        float h = cell.halfSize * 0.5f;
+        vec3 cc = cell.center + vec3(i & 1 ? h : -h, i & 2 ? h : -h, i & 4 ? h : -h);
+        return BoundingBox::fromCenterExtents(cc, vec3(h)).contains(box) ? i : -1;
+    }
+
+    void insert(Cell& start, const Entry& e) {
+        Cell* cell = &start;
+        for (;;) {
+            if (cell->isLeaf()) {
+                if (cell->objects.size() < cellCapacity || cell->depth >= maxDepth) {
+                    append(cell, e);
+                    return;
+                }
+                subdivide(*cell);
+            }
+            int i = childIndex(*cell, e.bounds);
+            if (i < 0) { append(cell, e); return; }
+            cell = cell->children[i].get();
+        }
+    }
+
+    void subdivide(Cell& cell) {
+        float h = cell.halfSize * 0.5f;
+        for (int i = 0; i < 8; ++i) {
+            vec3 off(
+                (i & 1 ?  h : -h),
+                (i & 2 ?  h : -h),
+                (i & 4 ?  h : -h)
+            );
+            cell.children[i] = std::make_unique<Cell>(cell.center + off, h, cell.depth + 1);
+        }
+        std::vector<Entry> objects;
+        objects.swap(cell.objects);
+        for (auto& e : objects) {
+            int i = childIndex(cell, e.bounds);
+            if (i < 0) append(&cell, e);
+            else insert(*cell.children[i], e);
+        }
+    }
+
+    void append(Cell* cell, const Entry& e) {
+        auto& list = cell ? cell->objects : outside;
+        locations.set(e.node, {cell, uint32_t(list.size())});
+        list.push_back(e);
+    }
+
+    // Cells entirely inside the frustum hand over their whole subtree untested.
+    void query(const Cell& cell, const FrustumCuller& culler,
+               std::vector<NodeHandle>& out, bool inside) const {
+        if (!inside) {
+            auto c = culler.classify(cell.bounds());
+            if (c == FrustumCuller::Containment::Outside) return;
+            inside = c == FrustumCuller::Containment::Inside;
+        }
+        for (auto& e : cell.objects)
+            if (inside || culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+        if (!cell.isLeaf())
+            for (auto& ch : cell.children) query(*ch, culler, out, inside);
+    }
+};
+
+// ---------------------------------------------
+// Loose octree partitioning
+//
+// Cells are enlarged by a looseness factor k around their strict bounds, so
+// an object only needs its center inside a cell and its largest half-extent
+// within (k - 1) * halfSize. That picks the level and cell directly from the
+// object's size and center, and a moving object keeps its cell until it
+// leaves the loose bounds. Cells live in one vector and are created on
+// demand.
+
+class LooseOctree final {
+    using Entry = PartitionEntry;
+
+    struct Cell {
+        vec3 center;
+        float halfSize;
+        std::array<int32_t, 8> children;
+        std::vector<Entry> objects;
+
+        Cell(const vec3& c, float hs) : center(c), halfSize(hs) { children.fill(-1); }
+    };
+
+    struct Location {
+        int32_t cell = -1;   // -1: outside list
+        uint32_t slot = 0;
+    };
+
+    std::vector<Cell> cells;
+    std::vector<Entry> outside;
+    HandleMap<Location> locations;
+    vec3 rootCenter;
+    float rootHalfSize;
+    float looseness;
+    int maxDepth;
+
+public:
+    LooseOctree(const vec3& c, float hs, float k = 2.0f, int depthLimit = 8)
+        : rootCenter(c), rootHalfSize(hs), looseness(std::max(k, 1.1f)), maxDepth(depthLimit) {
+        cells.emplace_back(rootCenter, rootHalfSize);
+    }
+
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || locations.find(node)) return;
+        place({node, n->worldBounds()});
+    }
+
+    // Refreshes the node's bounds; it is only moved when it has left the
+    // loose bounds of its current cell.
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        Location* loc = locations.find(node);
+        if (!n || !loc) { remove(node); insert(node); return; }
+        BoundingBox bb = n->worldBounds();
+        if (loc->cell >= 0 && looseBounds(cells[loc->cell]).contains(bb)) {
+            cells[loc->cell].objects[loc->slot].bounds = bb;
+            return;
+        }
+        remove(node);
+        place({node, bb});
+    }
+
+    void remove(NodeHandle node) {
+        Location* loc = locations.find(node);
+        if (!loc) return;
+        Location l = *loc;
+        locations.erase(node);
+        swapErase(l.cell >= 0 ? cells[l.cell].objects : outside, locations, l);
+    }
+
+    void clear() {
+        cells.clear();
+        cells.emplace_back(rootCenter, rootHalfSize);
+        outside.clear();
+        locations.clear();
+    }
+
+    void prepare() {}   // nothing is deferred
+
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        for (auto& e : outside)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+        query(0, culler, out, false);
+    }
+
+private:
+    BoundingBox looseBounds(const Cell& c) const {
+        return BoundingBox::fromCenterExtents(c.center, vec3(c.halfSize * looseness));
+    }
+
+    void place(const Entry& e) {
+        int32_t cell = targetCell(e.bounds);
+        auto& list = cell >= 0 ? cells[cell].objects : outside;
+        locations.set(e.node, {cell, uint32_t(list.size())});
+        list.push_back(e);
+    }
+
+    // Level from size, cell from center, creating the path on demand.
+    int32_t targetCell(const BoundingBox& bb) {
+        vec3 c = bb.center(), e = bb.extents();
+        vec3 rel = (c - rootCenter) / (2.0f * rootHalfSize) + vec3(0.5f);
+        if (rel.x < 0 || rel.y < 0 || rel.z < 0 || rel.x > 1 || rel.y > 1 || rel.z > 1)
+            return -1;
+
+        float radius = std::max(e.x, std::max(e.y, e.z));
+        float slack = rootHalfSize * (looseness - 1.0f);
+        if (radius > slack && radius > 0) return -1;   // too big for even the root's loose bounds
+        int depth = maxDepth;
+        if (radius > 0 && slack > 0)
+            depth = std::min(maxDepth, int(std::floor(std::log2(slack / radius))));
+
+        uint32_t cellsPerAxis = 1u << depth;
+        uint32_t ix = std::min(cellsPerAxis - 1, uint32_t(rel.x * cellsPerAxis));
+        uint32_t iy = std::min(cellsPerAxis - 1, uint32_t(rel.y * cellsPerAxis));
+        uint32_t iz = std::min(cellsPerAxis - 1, uint32_t(rel.z * cellsPerAxis));
+
+        int32_t cell = 0;
+        for (int level = depth - 1; level >= 0; --level) {
+            int octant = ((ix >> level) & 1) | (((iy >> level) & 1) << 1) | (((iz >> level) & 1) << 2);
+            int32_t child = cells[cell].children[octant];
+            if (child < 0) {
+                float h = cells[cell].halfSize * 0.5f;
+                vec3 off(octant & 1 ? h : -h, octant & 2 ? h : -h, octant & 4 ? h : -h);
+                child = int32_t(cells.size());
+                cells.emplace_back(cells[cell].center + off, h);
+                cells[cell].children[octant] = child;
+            }
+            cell = child;
+        }
+        return cell;
+    }
+
+    void query(int32_t index, const FrustumCuller& culler,
+               std::vector<NodeHandle>& out, bool inside) const {
+        const Cell& cell = cells[index];
+        if (!inside) {
+            auto c = culler.classify(looseBounds(cell));
+            if (c == FrustumCuller::Containment::Outside) return;
+            inside = c == FrustumCuller::Containment::Inside;
+        }
+        for (auto& e : cell.objects)
+            if (inside || culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+        for (int32_t ch : cell.children)
+            if (ch >= 0) query(ch, culler, out, inside);
+    }
+};
+
+// ---------------------------------------------
+// Linear octree partitioning
+//
+// Pointerless octree: entries are kept sorted by the Morton code of their
+// world AABB center, so every cell is the contiguous range of entries that
+// share a code prefix and no cell objects exist at all. Queries descend by
+// prefix and find child ranges by binary search. Cells are treated as loose
+// by the largest half-extent among the sorted entries, which keeps queries
+// conservative for objects overhanging their cell; objects outside the root
+// cube or bigger than a depth-4 cell are kept in a small linear list instead.
+// The array is re-sorted with a parallel LSD radix sort by prepare() after a
+// change that moved an entry to a different cell.
+
+class LinearOctree final {
+    struct Entry {
+        uint64_t code;
+        NodeHandle node;
+        BoundingBox bounds;
+    };
+
+    struct Location {
+        bool large = false;
+        uint32_t slot = 0;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<Entry> scratch;
+    std::vector<Entry> large;
+    HandleMap<Location> locations;
+    bool unsorted = false;
+    float maxExtent = 0;
+    vec3 rootCenter;
+    float rootHalfSize;
+    int depth;        // code levels, 3 bits each
+    size_t leafSize;
+    JobSystem* jobs;
+
+public:
+    LinearOctree(const vec3& c, float hs, int codeDepth = 10, size_t leaf = 16,
+                 JobSystem* js = &jobSystem())
+        : rootCenter(c), rootHalfSize(hs), depth(std::min(std::max(codeDepth, 1), 21)),
+          leafSize(leaf), jobs(js) {}
+
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || locations.find(node)) return;
+        add({0, node, n->worldBounds()});
+    }
+
+    // Stays in place (no re-sort) while the center keeps the same code.
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        Location* loc = locations.find(node);
+        if (!n || !loc) { remove(node); insert(node); return; }
+        BoundingBox bb = n->worldBounds();
+        if (!loc->large && !isLarge(bb)) {
+            Entry& e = entries[loc->slot];
+            uint64_t code = encode(bb.center());
+            unsorted = unsorted || code != e.code;
+            e.code = code;
+            e.bounds = bb;
+            maxExtent = std::max(maxExtent, largestExtent(bb));
+            return;
+        }
+        remove(node);
+        add({0, node, bb});
+    }
+
+    void remove(NodeHandle node) {
+        Location* loc = locations.find(node);
+        if (!loc) return;
+        Location l = *loc;
+        locations.erase(node);
+        if (swapErase(l.large ? large : entries, locations, l) && !l.large) unsorted = true;
+    }
+
+    void clear() {
+        entries.clear();
+        large.clear();
+        locations.clear();
+        unsorted = false;
+        maxExtent = 0;
+    }
+
+    void prepare() { if (unsorted) sort(); }
+
+    // Scans every entry while codes changed since the last prepare().
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        for (auto& e : large)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+        if (!unsorted) { query(0, entries.size(), 0, rootCenter, rootHalfSize, culler, out); return; }
+        for (auto& e : entries)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+    }
+
+private:
+    static float largestExtent(const BoundingBox& bb) {
+        vec3 e = bb.extents();
+        return std::max(e.x, std::max(e.y, e.z));
+    }
+
+    bool isLarge(const BoundingBox& bb) const {
+        vec3 d = glm::abs(bb.center() - rootCenter);
+        return d.x > rootHalfSize || d.y > rootHalfSize || d.z > rootHalfSize
+            || largestExtent(bb) > rootHalfSize / 16;
+    }
+
+    void add(Entry e) {
+        if (isLarge(e.bounds)) {
+            locations.set(e.node, {true, uint32_t(large.size())});
+            large.push_back(e);
+            return;
+        }
+        e.code = encode(e.bounds.center());
+        maxExtent = std::max(maxExtent, largestExtent(e.bounds));
+        locations.set(e.node, {false, uint32_t(entries.size())});
+        entries.push_back(e);
+        unsorted = true;
+    }
+
+    // Spreads the low 21 bits of v to every third bit.
+    static uint64_t spreadBits(uint64_t v) {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffULL;
+        v = (v | v << 16) & 0x1f0000ff0000ffULL;
+        v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+        v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+        v = (v | v << 2)  & 0x1249249249249249ULL;
+        return v;
+    }
+
+    uint64_t encode(const vec3& p) const {
+        vec3 rel = (p - rootCenter) / (2.0f * rootHalfSize) + vec3(0.5f);
+        float cells = float(1u << depth);
+        auto q = [&](float v) {
+            return uint64_t(std::min(cells - 1, std::max(0.0f, std::floor(v * cells))));
+        };
+        return spreadBits(q(rel.x)) | spreadBits(q(rel.y)) << 1 | spreadBits(q(rel.z)) << 2;
+    }
+
+    // Stable LSD radix sort of (code, index) keys, 11 bits per pass, followed
+    // by one gather of the entries. Each pass builds per-chunk histograms in
+    // parallel, turns them into chunk-private scatter offsets and scatters
+    // in parallel.
+    void sort() {
+        struct Key { uint64_t code; uint32_t index; };
+        const size_t n = entries.size();
+        const int bits = 3 * depth;
+        std::vector<Key> keys(n), tmp(n);
+        size_t chunks = jobs ? std::min<size_t>(jobs->threadCount() * 2, std::max<size_t>(1, n / 16384)) : 1;
+        size_t step = (n + chunks - 1) / std::max<size_t>(chunks, 1);
+        constexpr int radixBits = 11;
+        constexpr uint64_t radixMask = (1u << radixBits) - 1;
+        std::vector<std::array<size_t, 1u << radixBits>> offsets(chunks);
+
+        auto forChunks = [&](auto&& fn) {
+            if (chunks <= 1 || !jobs) { for (size_t c = 0; c < chunks; ++c) fn(c); return; }
+            JobGroup group;
+            for (size_t c = 0; c < chunks; ++c) jobs->spawn(group, [&fn, c]{ fn(c); });
+            jobs->wait(group);
+        };
+
+        forChunks([&](size_t c) {
+            for (size_t i = c * step, e = std::min(n, i + step); i < e; ++i)
+                keys[i] = {entries[i].code, uint32_t(i)};
+        });
+        for (int shift = 0; shift < bits; shift += radixBits) {
+            forChunks([&](size_t c) {
+                auto& h = offsets[c];
+                h.fill(0);
+                for (size_t i = c * step, e = std::min(n, i + step); i < e; ++i)
+                    ++h[(keys[i].code >> shift) & radixMask];
+            });
+            size_t sum = 0;
+            for (size_t d = 0; d <= radixMask; ++d)
+                for (size_t c = 0; c < chunks; ++c) {
+                    size_t count = offsets[c][d];
+                    offsets[c][d] = sum;
+                    sum += count;
+                }
+            forChunks([&](size_t c) {
+                auto& o = offsets[c];
+                for (size_t i = c * step, e = std::min(n, i + step); i < e; ++i)
+                    tmp[o[(keys[i].code >> shift) & radixMask]++] = keys[i];
+            });
+            keys.swap(tmp);
+        }
+
+        scratch.resize(n);
+        forChunks([&](size_t c) {
+            for (size_t i = c * step, e = std::min(n, i + step); i < e; ++i)
+                scratch[i] = entries[keys[i].index];
+        });
+        entries.swap(scratch);
+
+        maxExtent = 0;
+        for (uint32_t i = 0; i < n; ++i) {
+            if (keys[i].index != i) locations.set(entries[i].node, {false, i});
+            maxExtent = std::max(maxExtent, largestExtent(entries[i].bounds));
+        }
+        unsorted = false;
+    }
+
+    // [begin, end) holds the entries of the cell at this level; cells below
+    // are found by binary search on the next 3-bit digit.
+    void query(size_t begin, size_t end, int level, const vec3& center, float halfSize,
+               const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        if (begin == end) return;
+        auto c = culler.classify(BoundingBox::fromCenterExtents(center, vec3(halfSize + maxExtent)));
+        if (c == FrustumCuller::Containment::Outside) return;
+        if (c == FrustumCuller::Containment::Inside) {
+            for (size_t i = begin; i < end; ++i) out.push_back(entries[i].node);
+            return;
+        }
+        if (level == depth || end - begin <= leafSize) {
+            for (size_t i = begin; i < end; ++i)
+                if (culler.classify(entries[i].bounds) != FrustumCuller::Containment::Outside)
+                    out.push_back(entries[i].node);
+            return;
+        }
+
+        int shift = 3 * (depth - level - 1);
+        uint64_t base = entries[begin].code >> (shift + 3) << (shift + 3);
+        float h = halfSize * 0.5f;
+        size_t childBegin = begin;
+        for (uint64_t octant = 0; octant < 8; ++octant) {
+            uint64_t limit = base + ((octant + 1) << shift);
+            size_t childEnd = octant == 7 ? end : size_t(std::lower_bound(
+                entries.begin() + childBegin, entries.begin() + end, limit,
+                [](const Entry& e, uint64_t v) { return e.code < v; }) - entries.begin());
+            vec3 off(octant & 1 ? h : -h, octant & 2 ? h : -h, octant & 4 ? h : -h);
+            query(childBegin, childEnd, level + 1, center + off, h, culler, out);
+            childBegin = childEnd;
+        }
+    }
+};
+
+// ---------------------------------------------
+// BSP Tree partitioning
+
+// Node AABBs are classified against each split plane: boxes entirely in
+// front or behind descend, boxes that straddle stay at the node. Planes are
+// axis-aligned candidates through entry-center quantiles, picked by a cost
+// that weighs front/back imbalance (tree depth) against straddler count,
+// and leaves split once they exceed leafSize. prepare() files pending
+// inserts: a large batch is built top-down, a few are inserted one by one.
+// Queries skip a whole child when the frustum lies entirely on the other
+// side of the plane.
+
+class BSPTree final {
+    using Entry = PartitionEntry;
+
+    struct Node {
+        vec3 normal{0, 1, 0};
+        float distance = 0;
+        Node* parent = nullptr;
+        int depth = 0;
+        std::vector<Entry> objects;   // everything in a leaf, straddlers otherwise
+        std::unique_ptr<Node> front, back;
+
+        bool isLeaf() const { return !front; }
+    };
+
+    struct Location {
+        Node* node = nullptr;   // nullptr: pending list
+        uint32_t slot = 0;
+    };
+
+    Node root;
+    std::vector<Entry> pending;
+    HandleMap<Location> locations;
+    size_t treeSize = 0;
+    size_t leafSize;
+    int maxDepth;
+    float straddleCost;   // cost of one straddler relative to a unit of imbalance
+
+public:
+    BSPTree(size_t leaf = 8, int depthLimit = 32, float splitCost = 2.0f)
+        : leafSize(std::max<size_t>(leaf, 1)), maxDepth(depthLimit), straddleCost(splitCost) {}
+
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || locations.find(node)) return;
+        append(pending, nullptr, {node, n->worldBounds()});
+    }
+
+    // In place while the box stays inside the region of its tree node.
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        Location* loc = locations.find(node);
+        if (!n || !loc) { remove(node); insert(node); return; }
+        BoundingBox bb = n->worldBounds();
+        if (!loc->node || inRegion(*loc->node, bb)) {
+            (loc->node ? loc->node->objects : pending)[loc->slot].bounds = bb;
+            return;
+        }
+        remove(node);
+        append(pending, nullptr, {node, bb});
+    }
+
+    void remove(NodeHandle node) {
+        Location* loc = locations.find(node);
+        if (!loc) return;
+        Location l = *loc;
+        if (l.node) --treeSize;
+        locations.erase(node);
+        swapErase(l.node ? l.node->objects : pending, locations, l);
+    }
+
+    void clear() {
+        root.objects.clear();
+        root.front.reset();
+        root.back.reset();
+        pending.clear();
+        locations.clear();
+        treeSize = 0;
+    }
+
+    void prepare() { flush(); }
+
+    // Inserts not yet filed by prepare() are tested one by one.
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        for (auto& e : pending)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+        query(root, culler, out);
+    }
+
+    // Frustum query that emits nodes roughly ordered by distance from eye,
+    // straight from the traversal: at every split the eye's side is visited
+    // first (front-to-back) or last (back-to-front), with the node's
+    // straddlers in between. Entries sharing a cell (a leaf, or one node's
+    // straddlers) are sorted by the distance from eye to their box. The order
+    // is approximate: a straddler comes out after everything on the eye's
+    // side of its plane even when part of it is nearer, so a large object
+    // crossing a split can be misplaced against smaller ones, whatever the
+    // leafSize. Inserts not yet filed by prepare() come last (front-to-back)
+    // or first (back-to-front), sorted among themselves.
+    void queryOrdered(const FrustumCuller& culler, const vec3& eye, bool frontToBack,
+                      std::vector<NodeHandle>& out) const {
+        if (!frontToBack) emitSorted(pending, culler, eye, frontToBack, out);
+        queryOrdered(root, culler, eye, frontToBack, out);
+        if (frontToBack) emitSorted(pending, culler, eye, frontToBack, out);
+    }
+
+private:
+    enum Side { Back = -1, Straddle = 0, Front = 1 };
+
+    static Side side(const Node& n, const BoundingBox& bb) {
+        float s = glm::dot(n.normal, bb.center()) - n.distance;
+        float r = glm::dot(glm::abs(n.normal), bb.extents());
+        return s > r ? Front : s < -r ? Back : Straddle;
+    }
+
+    // True if bb still lies in the half-spaces leading from the root to n.
+    static bool inRegion(const Node& n, const BoundingBox& bb) {
+        for (const Node* c = &n; c->parent; c = c->parent) {
+            Side want = c->parent->front.get() == c ? Front : Back;
+            if (side(*c->parent, bb) != want) return false;
+        }
+        return true;
+    }
+
+    void append(std::vector<Entry>& list, Node* node, const Entry& e) {
+        locations.set(e.node, {node, uint32_t(list.size())});
+        list.push_back(e);
+        if (node) ++treeSize;
+    }
+
+    // Big batches (e.g. a full re-insert) get a top-down build over
+    // everything; a trickle of new or moved nodes is inserted one by one.
+    void flush() {
+        if (pending.empty()) return;
+        std::vector<Entry> batch;
+        batch.swap(pending);
+        if (batch.size() * 2 >= treeSize) {
+            collect(root, batch);
+            root.objects.clear();
+            root.front.reset();
+            root.back.reset();
+            treeSize = 0;
+            build(root, std::move(batch));
+        } else {
+            for (auto& e : batch) insert(e);
+        }
+    }
+
+    static void collect(Node& n, std::vector<Entry>& out) {
+        out.insert(out.end(), n.objects.begin(), n.objects.end());
+        if (n.front) collect(*n.front, out);
+        if (n.back) collect(*n.back, out);
+    }
+
+    void insert(const Entry& e) {
+        Node* n = &root;
+        while (!n->isLeaf()) {
+            Side sd = side(*n, e.bounds);
+            if (sd == Straddle) break;
+            n = sd == Front ? n->front.get() : n->back.get();
+        }
+        append(n->objects, n, e);
+        if (n->isLeaf() && n->objects.size() > leafSize && n->depth < maxDepth) {
+            std::vector<Entry> objects;
+            objects.swap(n->objects);
+            treeSize -= objects.size();
+            build(*n, std::move(objects));
+        }
+    }
+
+    // Picks a split plane for entries; false if no split beats staying a leaf.
+    bool choosePlane(const std::vector<Entry>& entries, vec3& normal, float& distance) const {
+        constexpr size_t maxSamples = 1024;
+        size_t stride = std::max<size_t>(1, entries.size() / maxSamples);
+        std::vector<float> centers;
+        float bestCost = std::numeric_limits<float>::max();
+        bool found = false;
+
+        for (int axis = 0; axis < 3; ++axis) {
+            centers.clear();
+            for (size_t i = 0; i < entries.size(); i += stride)
+                centers.push_back(entries[i].bounds.center()[axis]);
+            int quantiles = entries.size() > 64 ? 8 : 4;
+            for (int q = 1; q < quantiles; ++q) {
+                auto mid = centers.begin() + centers.size() * q / quantiles;
+                std::nth_element(centers.begin(), mid, centers.end());
+                Node probe;
+                probe.normal = vec3(0.0f);
+                probe.normal[axis] = 1.0f;
+                probe.distance = *mid;
+
+                size_t counts[3] = {0, 0, 0};
+                for (size_t i = 0; i < entries.size(); i += stride)
+                    ++counts[side(probe, entries[i].bounds) + 1];
+                size_t sampled = counts[0] + counts[1] + counts[2];
+                if (counts[0] == 0 || counts[2] == 0) continue;   // splits nothing off
+                float imbalance = std::fabs(float(counts[2]) - float(counts[0])) / sampled;
+                float cost = imbalance + straddleCost * float(counts[1]) / sampled;
+                if (cost < bestCost) {
+                    bestCost = cost;
+                    normal = probe.normal;
+                    distance = probe.distance;
+                    found = true;
+                }
+            }
+        }
+        return found;
+    }
+
+    void build(Node& n, std::vector<Entry> entries) {
+        if (entries.size() <= leafSize || n.depth >= maxDepth
+            || !choosePlane(entries, n.normal, n.distance)) {
+            for (auto& e : entries) append(n.objects, &n, e);
+            return;
+        }
+        std::vector<Entry> frontSet, backSet;
+        for (auto& e : entries) {
+            Side sd = side(n, e.bounds);
+            if (sd == Front) frontSet.push_back(e);
+            else if (sd == Back) backSet.push_back(e);
+            else append(n.objects, &n, e);
+        }
+        entries.clear();
+        entries.shrink_to_fit();
+        n.front = std::make_unique<Node>();
+        n.back = std::make_unique<Node>();
+        for (Node* c : {n.front.get(), n.back.get()}) {
+            c->parent = &n;
+            c->depth = n.depth + 1;
+        }
+        build(*n.front, std::move(frontSet));
+        build(*n.back, std::move(backSet));
+    }
+
+    void query(const Node& n, const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        emitVisible(n, culler, out);
+        if (n.isLeaf()) return;
+        Side sd = frustumSide(n, culler);
+        if (sd != Back) query(*n.front, culler, out);
+        if (sd != Front) query(*n.back, culler, out);
+    }
+
+    void emitVisible(const Node& n, const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        for (auto& e : n.objects)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+    }
+
+    // Appends the visible entries of list sorted by distance from eye.
+    static void emitSorted(const std::vector<Entry>& list, const FrustumCuller& culler, const vec3& eye,
+                           bool frontToBack, std::vector<NodeHandle>& out) {
+        std::vector<std::pair<float, NodeHandle>> run;
+        for (auto& e : list)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside) {
+                vec3 d = glm::max(glm::max(e.bounds.min - eye, eye - e.bounds.max), vec3(0.0f));
+                run.push_back({glm::dot(d, d), e.node});
+            }
+        auto byDistance = [&](const auto& a, const auto& b) {
+            return frontToBack ? a.first < b.first : a.first > b.first;
+        };
+        std::stable_sort(run.begin(), run.end(), byDistance);
+        for (auto& r : run) out.push_back(r.second);
+    }
+
+    void queryOrdered(const Node& n, const FrustumCuller& culler, const vec3& eye,
+                      bool frontToBack, std::vector<NodeHandle>& out) const {
+        if (n.isLeaf()) { emitSorted(n.objects, culler, eye, frontToBack, out); return; }
+        bool eyeInFront = glm::dot(n.normal, eye) - n.distance >= 0;
+        const Node* nearChild = eyeInFront ? n.front.get() : n.back.get();
+        const Node* farChild  = eyeInFront ? n.back.get()  : n.front.get();
+        Side sd = frustumSide(n, culler);
+        bool visitNear = sd == Straddle || (sd == Front) == eyeInFront;
+        bool visitFar  = sd == Straddle || (sd == Front) != eyeInFront;
+
+        if (!frontToBack) std::swap(nearChild, farChild), std::swap(visitNear, visitFar);
+        if (visitNear) queryOrdered(*nearChild, culler, eye, frontToBack, out);
+        emitSorted(n.objects, culler, eye, frontToBack, out);
+        if (visitFar) queryOrdered(*farChild, culler, eye, frontToBack, out);
+    }
+
+    // Side of the plane holding the whole frustum, Straddle if it spans it.
+    static Side frustumSide(const Node& n, const FrustumCuller& culler) {
+        bool anyFront = false, anyBack = false;
+        for (auto& c : culler.corners()) {
+            float s = glm::dot(n.normal, c) - n.distance;
+            anyFront = anyFront || s >= 0;
+            anyBack = anyBack || s <= 0;
+        }
+        return anyFront && anyBack ? Straddle : anyFront ? Front : Back;
+    }
 };
 
 // ---------------------------------------------
-// Transform class
+// Bounding volume hierarchy partitioning
+//
+// Binary BVH over node world AABBs in one flat array of 32-byte nodes; the
+// children of an inner node are stored as a pair, leaves reference a range
+// of the primitive order array. Splits come from a binned Surface Area
+// Heuristic evaluated on all three axes, which copes well with objects of
+// wildly different sizes. Subtrees above parallelGrain primitives are built
+// as JobSystem jobs. Inserts and removes mark the tree stale; it is rebuilt
+// by prepare().
+//
+// In refit mode moved nodes do not trigger a rebuild: prepare() refits
+// the bounds on their leaf-to-root paths, tracking the SAH cost as it goes.
+// Once the cost has grown past rebuildRatio times its value after the last
+// build, a fresh tree is built in the background and swapped in when ready.
+
+class BVH final {
+    struct Node {
+        float min[3];
+        uint32_t leftOrFirst;   // inner: left child (right is +1); leaf: first index into order
+        float max[3];
+        uint32_t count;         // primitives in a leaf, 0 for inner nodes
+
+        BoundingBox bounds() const { return {{min[0], min[1], min[2]}, {max[0], max[1], max[2]}}; }
+        void setBounds(const BoundingBox& b) {
+            for (int i = 0; i < 3; ++i) { min[i] = b.min[i]; max[i] = b.max[i]; }
+        }
+    };
+    static_assert(sizeof(Node) == 32, "BVH nodes must stay 32 bytes");
+
+    static constexpr uint32_t none = ~0u;
+
+    struct Tree {
+        std::vector<Node> nodes;
+        std::vector<uint32_t> order;    // primitive indices, leaves own ranges
+        std::vector<uint32_t> parent;   // per node, none for the root
+        std::vector<uint32_t> leafOf;   // per primitive
+        double sah = 0;                 // sum of inner areas + leaf areas * count
+
+        float cost() const { return nodes.empty() ? 0.0f : float(sah / std::max(nodes[0].bounds().surfaceArea(), 1e-20f)); }
+    };
+
+    struct Prim {
+        NodeHandle node;
+        BoundingBox bounds;
+    };
+
+    // Background rebuild: works on its own copy of the bounds.
+    struct AsyncBuild {
+        JobGroup group;
+        std::vector<BoundingBox> bounds;
+        Tree tree;
+        uint64_t topology = 0;
+        std::vector<uint32_t> movedSince;   // primitives updated after the copy
+    };
+
+    static constexpr int binCount = 16;
+
+    std::vector<Prim> prims;
+    HandleMap<uint32_t> slots;   // index into prims
+    uint64_t topology = 0;       // bumped by insert/remove
+    Tree tree;
+    bool stale = false;
+    std::vector<uint32_t> refitQueue;
+    float builtCost = 0;
+    std::unique_ptr<AsyncBuild> async;
+    size_t maxLeafSize;
+    JobSystem* jobs;
+    bool refitMode = false;
+    float rebuildRatio = 1.5f;
 
-class Transform {
-private:
-    vec3 position;
-    quat rotation;
-    vec3 scale;
-    mutable mat4 localMatrix;
-    mutable bool dirty;
 public:
-    Transform()
-        : position(0.0f), rotation(quat()), scale(1.0f),
-          localMatrix(1.0f), dirty(true) {}
+    size_t parallelGrain = 8192;   // primitives per build job
 
-    void setPosition(const vec3& pos) { position = pos; dirty = true; }
-    void setRotation(const quat& rot)  { rotation = rot; dirty = true; }
-    void setScale(const vec3& scl)     { scale    = scl; dirty = true; }
+    explicit BVH(size_t leaf = 4, JobSystem* js = &jobSystem())
+        : maxLeafSize(std::max<size_t>(leaf, 1)), jobs(js) {}
 
-    vec3 getPosition() const { return position; }
-    quat getRotation() const { return rotation; }
-    vec3 getScale()    const { return scale; }
+    ~BVH() { if (async) jobs->wait(async->group); }
 
-    mat4 getMatrix() const {
-        if (dirty) {
-            mat4 t = glm::translate(mat4(1.0f), position);
-            mat4 r = glm::mat4_cast(rotation);
-            mat4 s = glm::scale(mat4(1.0f), scale);
-            localMatrix = t * r * s;
-            dirty = false;
-        }
-        return localMatrix;
+    void setRefitMode(bool enable, float ratio = 1.5f) {
+        refitMode = enable;
+        rebuildRatio = std::max(ratio, 1.0f);
     }
-};
 
-// ---------------------------------------------
-// Forward declaration
+    // SAH cost of the current tree relative to when it was built.
+    float degradation() const { return builtCost > 0 ? tree.cost() / builtCost : 1.0f; }
 
-class SceneNode;
-using SceneNodePtr = std::shared_ptr<SceneNode>;
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || slots.find(node)) return;
+        slots.set(node, uint32_t(prims.size()));
+        prims.push_back({node, n->worldBounds()});
+        stale = true;
+        ++topology;
+    }
 
-// ---------------------------------------------
-// Partitioning interface
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        uint32_t* slot = slots.find(node);
+        if (!n || !slot) { remove(node); insert(node); return; }
+        prims[*slot].bounds = n->worldBounds();
+        if (!refitMode || stale) { stale = true; return; }
+        refitQueue.push_back(*slot);
+        if (async) async->movedSince.push_back(*slot);
+    }
 
-class PartitioningStrategy {
-public:
-    virtual void insert(const SceneNodePtr& node) = 0;
-    virtual void clear() = 0;
-    virtual ~PartitioningStrategy() = default;
-};
+    void remove(NodeHandle node) {
+        uint32_t* slot = slots.find(node);
+        if (!slot) return;
+        uint32_t i = *slot;
+        slots.erase(node);
+        if (i + 1 != prims.size()) {
+            prims[i] = prims.back();
+            slots.set(prims[i].node, i);
+        }
+        prims.pop_back();
+        stale = true;
+        ++topology;
+    }
 
-// ---------------------------------------------
-// Level of Detail (LOD)
+    void clear() {
+        if (async) { jobs->wait(async->group); async.reset(); }
+        prims.clear();
+        slots.clear();
+        tree = Tree();
+        refitQueue.clear();
+        stale = false;
+        ++topology;
+    }
 
-struct LODLevel {
-    float distanceThreshold;
-    std::string meshName;
-};
+    // Rebuilds a stale tree, refits moved primitives, adopts a finished
+    // background build and starts one once refits have degraded the tree.
+    void prepare() {
+        if (async && async->group.done()) adopt();
+        if (stale) {
+            if (async) { jobs->wait(async->group); async.reset(); }
+            std::vector<BoundingBox> bounds(prims.size());
+            for (size_t i = 0; i < prims.size(); ++i) bounds[i] = prims[i].bounds;
+            tree = Tree();
+            build(bounds, tree, maxLeafSize, parallelGrain, jobs);
+            builtCost = tree.cost();
+            refitQueue.clear();
+            stale = false;
+            return;
+        }
+        if (refitQueue.empty()) return;
+        refit();
+        if (!async && builtCost > 0 && tree.cost() > builtCost * rebuildRatio) startRebuild();
+    }
 
-class LOD {
-public:
-    std::vector<LODLevel> levels;
+    // Scans every primitive while the tree is out of date.
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        if (stale || !refitQueue.empty()) {
+            for (auto& p : prims)
+                if (culler.classify(p.bounds) != FrustumCuller::Containment::Outside)
+                    out.push_back(p.node);
+            return;
+        }
+        const auto& nodes = tree.nodes;
+        if (nodes.empty()) return;
+        std::pair<uint32_t, bool> stack[128];   // (node, inside); build depth is capped at 60
+        int top = 0;
+        stack[top++] = {0, false};
+        while (top > 0) {
+            auto [index, inside] = stack[--top];
+            const Node& n = nodes[index];
+            if (!inside) {
+                auto c = culler.classify(n.bounds());
+                if (c == FrustumCuller::Containment::Outside) continue;
+                inside = c == FrustumCuller::Containment::Inside;
+            }
+            if (n.count > 0) {
+                for (uint32_t i = n.leftOrFirst; i < n.leftOrFirst + n.count; ++i) {
+                    const Prim& p = prims[tree.order[i]];
+                    if (inside || culler.classify(p.bounds) != FrustumCuller::Containment::Outside)
+                        out.push_back(p.node);
+                }
+                continue;
+            }
+            stack[top++] = {n.leftOrFirst + 1, inside};
+            stack[top++] = {n.leftOrFirst, inside};
+        }
+    }
 
-    void addLevel(float distance, const std::string& mesh) {
-        levels.push_back({distance, mesh});
-        std::sort(levels.begin(), levels.end(),
-            [](auto& a, auto& b){ return a.distanceThreshold < b.distanceThreshold; });
+private:
+    void startRebuild() {
+        if (!jobs || jobs->threadCount() == 1) {   // nobody to run it in the background
+            stale = true;
+            prepare();
+            return;
+        }
+        async = std::make_unique<AsyncBuild>();
+        async->topology = topology;
+        async->bounds.resize(prims.size());
+        for (size_t i = 0; i < prims.size(); ++i) async->bounds[i] = prims[i].bounds;
+        AsyncBuild* job = async.get();
+        size_t leaf = maxLeafSize, grain = parallelGrain;
+        JobSystem* js = jobs;
+        jobs->spawn(job->group, [job, leaf, grain, js]{ build(job->bounds, job->tree, leaf, grain, js); });
     }
 
-    std::string getMesh(float distance) const {
-        for (auto& lvl : levels)
-            if (distance < lvl.distanceThreshold) return lvl.meshName;
-        return levels.empty() ? std::string() : levels.back().meshName;
+    // Swaps in a finished background build, then refits the primitives that
+    // moved while it was running.
+    void adopt() {
+        std::unique_ptr<AsyncBuild> done = std::move(async);
+        if (done->topology != topology) return;   // inserts/removes happened meanwhile
+        tree = std::move(done->tree);
+        builtCost = tree.cost();
+        refitQueue.insert(refitQueue.end(), done->movedSince.begin(), done->movedSince.end());
+    }
+
+    void setNodeBounds(uint32_t index, const BoundingBox& b) {
+        Node& n = tree.nodes[index];
+        tree.sah += double(b.surfaceArea() - n.bounds().surfaceArea()) * (n.count ? n.count : 1);
+        n.setBounds(b);
+    }
+
+    // Walks each moved primitive's leaf-to-root path, stopping as soon as a
+    // node's bounds come out unchanged.
+    void refit() {
+        for (uint32_t p : refitQueue) {
+            uint32_t index = tree.leafOf[p];
+            const Node& leaf = tree.nodes[index];
+            BoundingBox b = BoundingBox::empty();
+            for (uint32_t i = leaf.leftOrFirst; i < leaf.leftOrFirst + leaf.count; ++i)
+                b.expand(prims[tree.order[i]].bounds);
+            while (b != tree.nodes[index].bounds()) {
+                setNodeBounds(index, b);
+                index = tree.parent[index];
+                if (index == none) break;
+                const Node& n = tree.nodes[index];
+                b = tree.nodes[n.leftOrFirst].bounds();
+                b.expand(tree.nodes[n.leftOrFirst + 1].bounds());
+            }
+        }
+        refitQueue.clear();
+    }
+
+    struct Builder {
+        const std::vector<BoundingBox>& bounds;
+        Tree& tree;
+        size_t maxLeafSize;
+        size_t parallelGrain;
+        JobSystem* jobs;
+        std::atomic<uint32_t> nodesUsed{1};
+
+        void node(uint32_t index, uint32_t begin, uint32_t end, int depth, JobGroup* group) {
+            BoundingBox box = BoundingBox::empty(), centroids = BoundingBox::empty();
+            for (uint32_t i = begin; i < end; ++i) {
+                const BoundingBox& b = bounds[tree.order[i]];
+                box.expand(b);
+                vec3 c = b.center();
+                centroids.expand(c);
+            }
+            Node& n = tree.nodes[index];
+            n.setBounds(box);
+            uint32_t count = end - begin;
+
+            uint32_t mid = begin;
+            if (count > maxLeafSize && depth < 60) mid = split(begin, end, box, centroids);
+            if (mid == begin || mid == end) {
+                n.leftOrFirst = begin;
+                n.count = count;
+                return;
+            }
+
+            uint32_t left = nodesUsed.fetch_add(2, std::memory_order_relaxed);
+            n.leftOrFirst = left;
+            n.count = 0;
+            if (group && mid - begin > parallelGrain) {
+                jobs->spawn(*group, [this, left, begin, mid, depth, group]{
+                    node(left, begin, mid, depth + 1, group);
+                });
+            } else {
+                node(left, begin, mid, depth + 1, group);
+            }
+            node(left + 1, mid, end, depth + 1, group);
+        }
+
+        // Binned SAH over the centroid bounds; partitions order[begin, end)
+        // and returns the split point, or begin when a leaf is cheaper.
+        uint32_t split(uint32_t begin, uint32_t end, const BoundingBox& box,
+                       const BoundingBox& centroids) {
+            float bestCost = std::numeric_limits<float>::max();
+            int bestAxis = -1, bestBin = 0;
+            vec3 extent = centroids.max - centroids.min;
+
+            for (int axis = 0; axis < 3; ++axis) {
+                if (extent[axis] <= 0) continue;
+                BoundingBox bins[binCount];
+                uint32_t counts[binCount] = {};
+                for (auto& b : bins) b = BoundingBox::empty();
+                float scale = binCount / extent[axis];
+                for (uint32_t i = begin; i < end; ++i) {
+                    const BoundingBox& b = bounds[tree.order[i]];
+                    int bin = std::min(binCount - 1, int((b.center()[axis] - centroids.min[axis]) * scale));
+                    ++counts[bin];
+                    bins[bin].expand(b);
+                }
+
+                float rightArea[binCount];
+                uint32_t rightCount[binCount];
+                BoundingBox acc = BoundingBox::empty();
+                uint32_t n = 0;
+                for (int i = binCount - 1; i > 0; --i) {
+                    n += counts[i];
+                    if (counts[i]) acc.expand(bins[i]);
+                    rightArea[i] = n ? acc.surfaceArea() : 0;
+                    rightCount[i] = n;
+                }
+                acc = BoundingBox::empty();
+                n = 0;
+                for (int i = 0; i < binCount - 1; ++i) {
+                    n += counts[i];
+                    if (counts[i]) acc.expand(bins[i]);
+                    if (n == 0 || rightCount[i + 1] == 0) continue;
+                    float cost = acc.surfaceArea() * n + rightArea[i + 1] * rightCount[i + 1];
+                    if (cost < bestCost) { bestCost = cost; bestAxis = axis; bestBin = i; }
+                }
+            }
+
+            uint32_t count = end - begin;
+            float leafCost = box.surfaceArea() * count;
+            if (bestAxis < 0 || (bestCost >= leafCost && count <= 4 * maxLeafSize)) {
+                if (count <= 4 * maxLeafSize) return begin;
+                return begin + count / 2;   // identical centroids: split by count
+            }
+
+            float scale = binCount / extent[bestAxis];
+            float lo = centroids.min[bestAxis];
+            auto it = std::partition(tree.order.begin() + begin, tree.order.begin() + end, [&](uint32_t p) {
+                int bin = std::min(binCount - 1, int((bounds[p].center()[bestAxis] - lo) * scale));
+                return bin <= bestBin;
+            });
+            return uint32_t(it - tree.order.begin());
+        }
+    };
+
+    static void build(const std::vector<BoundingBox>& bounds, Tree& t,
+                      size_t maxLeaf, size_t grain, JobSystem* jobs) {
+        size_t n = bounds.size();
+        t.order.resize(n);
+        if (n == 0) return;
+        for (uint32_t i = 0; i < n; ++i) t.order[i] = i;
+        t.nodes.resize(2 * n - 1);
+
+        Builder builder{bounds, t, maxLeaf, grain, jobs};
+        if (jobs && jobs->threadCount() > 1 && n > grain) {
+            JobGroup group;
+            builder.node(0, 0, uint32_t(n), 0, &group);
+            jobs->wait(group);
+        } else {
+            builder.node(0, 0, uint32_t(n), 0, nullptr);
+        }
+        t.nodes.resize(builder.nodesUsed);
+
+        t.parent.assign(t.nodes.size(), none);
+        t.leafOf.assign(n, none);
+        t.sah = 0;
+        for (uint32_t i = 0; i < t.nodes.size(); ++i) {
+            const Node& node = t.nodes[i];
+            t.sah += double(node.bounds().surfaceArea()) * (node.count ? node.count : 1);
+            if (node.count == 0) {
+                t.parent[node.leftOrFirst] = t.parent[node.leftOrFirst + 1] = i;
+            } else {
+                for (uint32_t k = node.leftOrFirst; k < node.leftOrFirst + node.count; ++k)
+                    t.leafOf[t.order[k]] = i;
+            }
+        }
     }
 };
 
 // ---------------------------------------------
-// Scene Node
+// Spatial hash grid partitioning
+//
+// Uniform grid of cubic cells stored sparsely in an open-addressing hash
+// table (power-of-two capacity, linear probing) keyed by integer cell
+// coordinates. Objects are filed under the cell holding their center, so
+// insert, move and remove are O(1) swap-and-pop operations. Cells are
+// treated as loose by half a cell on every side; objects with a half-extent
+// beyond that live in a small linear list. Suited to many similarly sized
+// objects, with the cell size chosen around their diameter.
+
+class SpatialHashGrid final {
+    using Entry = PartitionEntry;
+
+    struct Bucket {
+        int32_t x = 0, y = 0, z = 0;
+        bool used = false;
+        std::vector<Entry> objects;
+    };
+
+    struct Location {
+        int32_t bucket = -1;   // -1: large list
+        uint32_t slot = 0;
+    };
+
+    std::vector<Bucket> buckets;
+    size_t usedBuckets = 0;
+    std::vector<Entry> large;
+    HandleMap<Location> locations;
+    float cellSize;
+    float invCellSize;
 
-class SceneNode : public std::enable_shared_from_this<SceneNode> {
 public:
-    std::string name;
-    Transform transform;
-    std::weak_ptr<SceneNode> parent;
-    std::vector<SceneNodePtr> children;
-    BoundingBox boundingBox;
-    LOD lod;
-    bool visible;
+    explicit SpatialHashGrid(float cell = 10.0f, size_t initialBuckets = 64)
+        : cellSize(std::max(cell, 1e-6f)), invCellSize(1.0f / cellSize) {
+        size_t n = 16;
+        while (n < initialBuckets) n <<= 1;
+        buckets.resize(n);
+    }
 
-    SceneNode(const std::string& n)
-        : name(n), boundingBox({{-1,-1,-1},{1,1,1}}), visible(true) {}
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || locations.find(node)) return;
+        place({node, n->worldBounds()});
+    }
 
-    void addChild(const SceneNodePtr& child) {
-        child->parent = shared_from_this();
-        children.push_back(child);
+    // Bounds are refreshed in place while the center stays in its cell.
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        Location* loc = locations.find(node);
+        if (!n || !loc) { remove(node); insert(node); return; }
+        BoundingBox bb = n->worldBounds();
+        if (loc->bucket >= 0 && fits(bb)) {
+            Bucket& b = buckets[loc->bucket];
+            std::array<int32_t, 3> c = cellOf(bb.center());
+            if (c[0] == b.x && c[1] == b.y && c[2] == b.z) {
+                b.objects[loc->slot].bounds = bb;
+                return;
+            }
+        }
+        remove(node);
+        place({node, bb});
     }
-    void removeChild(const SceneNodePtr& child) {
-        children.erase(
-            std::remove(children.begin(), children.end(), child),
-            children.end()
-        );
+
+    void remove(NodeHandle node) {
+        Location* loc = locations.find(node);
+        if (!loc) return;
+        Location l = *loc;
+        locations.erase(node);
+        swapErase(l.bucket >= 0 ? buckets[l.bucket].objects : large, locations, l);
     }
 
-    mat4 getWorldMatrix() const {
-        if (auto p = parent.lock())
-            return p->getWorldMatrix() * transform.getMatrix();
-        return transform.getMatrix();
+    void clear() {
+        for (auto& b : buckets) b = Bucket();
+        usedBuckets = 0;
+        large.clear();
+        locations.clear();
     }
 
-    void updateWorldMatrix(bool force = false) {
-        (void)force;
-        for (auto& c : children) c->updateWorldMatrix(force);
+    void prepare() {}   // nothing is deferred
+
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        for (auto& e : large)
+            if (culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                out.push_back(e.node);
+
+        BoundingBox region{culler.corners()[0], culler.corners()[0]};
+        for (auto& p : culler.corners()) {
+            region.expand(p);
+        }
+        forEachCell(region, [&](const Bucket& b) {
+            auto c = culler.classify(looseBounds(b));
+            if (c == FrustumCuller::Containment::Outside) return;
+            bool inside = c == FrustumCuller::Containment::Inside;
+            for (auto& e : b.objects)
+                if (inside || culler.classify(e.bounds) != FrustumCuller::Containment::Outside)
+                    out.push_back(e.node);
+        });
     }
 
-    void draw(int depth = 0) const {
-        for (int i = 0; i < depth; ++i) std::cout << "  ";
-        std::cout << name << " [Visible: " << visible << "]\n";
-        for (auto& c : children) c->draw(depth + 1);
+    // Appends the nodes whose world bounds intersect the sphere.
+    void querySphere(const vec3& center, float radius, std::vector<NodeHandle>& out) const {
+        float r2 = radius * radius;
+        auto touches = [&](const BoundingBox& bb) {
+            vec3 d = glm::max(bb.min - center, vec3(0.0f)) + glm::max(center - bb.max, vec3(0.0f));
+            return glm::dot(d, d) <= r2;
+        };
+        for (auto& e : large)
+            if (touches(e.bounds)) out.push_back(e.node);
+        forEachCell(BoundingBox::fromCenterExtents(center, vec3(radius)), [&](const Bucket& b) {
+            if (!touches(looseBounds(b))) return;
+            for (auto& e : b.objects)
+                if (touches(e.bounds)) out.push_back(e.node);
+        });
+    }
+
+private:
+    std::array<int32_t, 3> cellOf(const vec3& p) const {
+        return {int32_t(std::floor(p.x * invCellSize)),
+                int32_t(std::floor(p.y * invCellSize)),
+                int32_t(std::floor(p.z * invCellSize))};
+    }
+
+    bool fits(const BoundingBox& bb) const {
+        vec3 e = bb.extents();
+        float half = 0.5f * cellSize;
+        if (!(e.x <= half && e.y <= half && e.z <= half)) return false;
+        vec3 c = bb.center() * invCellSize;   // keep cell coordinates in int32 range
+        float limit = float(1 << 30);
+        return std::abs(c.x) < limit && std::abs(c.y) < limit && std::abs(c.z) < limit;
+    }
+
+    BoundingBox looseBounds(const Bucket& b) const {
+        vec3 lo = vec3(float(b.x), float(b.y), float(b.z)) * cellSize;
+        return {lo - vec3(0.5f * cellSize), lo + vec3(1.5f * cellSize)};
+    }
+
+    static size_t hash(int32_t x, int32_t y, int32_t z) {
+        return size_t(uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u);
+    }
+
+    // Probes for the cell; returns -1 when it has no bucket.
+    int32_t findBucket(int32_t x, int32_t y, int32_t z) const {
+        size_t mask = buckets.size() - 1;
+        for (size_t i = hash(x, y, z) & mask;; i = (i + 1) & mask) {
+            const Bucket& b = buckets[i];
+            if (!b.used) return -1;
+            if (b.x == x && b.y == y && b.z == z) return int32_t(i);
+        }
+    }
+
+    int32_t findOrAddBucket(int32_t x, int32_t y, int32_t z) {
+        if ((usedBuckets + 1) * 2 > buckets.size()) rehash();
+        size_t mask = buckets.size() - 1;
+        for (size_t i = hash(x, y, z) & mask;; i = (i + 1) & mask) {
+            Bucket& b = buckets[i];
+            if (!b.used) {
+                b.x = x; b.y = y; b.z = z;
+                b.used = true;
+                ++usedBuckets;
+                return int32_t(i);
+            }
+            if (b.x == x && b.y == y && b.z == z) return int32_t(i);
+        }
+    }
+
+    // Re-inserts the occupied cells, dropping the ones that emptied out, and
+    // doubles the table when they still fill more than a quarter of it.
+    void rehash() {
+        size_t live = 0;
+        for (auto& b : buckets) live += b.used && !b.objects.empty();
+        size_t capacity = buckets.size();
+        if ((live + 1) * 4 > capacity) capacity *= 2;
+
+        std::vector<Bucket> old(capacity);
+        old.swap(buckets);
+        usedBuckets = 0;
+        size_t mask = capacity - 1;
+        for (auto& b : old) {
+            if (!b.used || b.objects.empty()) continue;
+            size_t i = hash(b.x, b.y, b.z) & mask;
+            while (buckets[i].used) i = (i + 1) & mask;
+            buckets[i] = std::move(b);
+            ++usedBuckets;
+            for (uint32_t s = 0; s < buckets[i].objects.size(); ++s)
+                locations.set(buckets[i].objects[s].node, {int32_t(i), s});
+        }
+    }
+
+    void place(const Entry& e) {
+        int32_t bucket = -1;
+        if (fits(e.bounds)) {
+            std::array<int32_t, 3> c = cellOf(e.bounds.center());
+            bucket = findOrAddBucket(c[0], c[1], c[2]);
+        }
+        auto& list = bucket >= 0 ? buckets[bucket].objects : large;
+        locations.set(e.node, {bucket, uint32_t(list.size())});
+        list.push_back(e);
+    }
+
+    // Visits the non-empty cells whose loose bounds may overlap the region,
+    // probing the cell range directly or scanning the table, whichever is
+    // shorter.
+    template <typename Fn>
+    void forEachCell(const BoundingBox& region, Fn&& fn) const {
+        double lo[3], hi[3], cells = 1;
+        for (int a = 0; a < 3; ++a) {
+            lo[a] = std::floor((double(region.min[a]) - 0.5 * cellSize) * invCellSize);
+            hi[a] = std::floor((double(region.max[a]) + 0.5 * cellSize) * invCellSize);
+            lo[a] = std::max(lo[a], -double(1 << 30));   // no object is filed beyond this
+            hi[a] = std::min(hi[a], double(1 << 30));
+            if (lo[a] > hi[a]) return;
+            cells *= hi[a] - lo[a] + 1;
+        }
+        if (cells > double(buckets.size())) {
+            for (auto& b : buckets)
+                if (b.used && !b.objects.empty() &&
+                    b.x >= lo[0] && b.x <= hi[0] && b.y >= lo[1] && b.y <= hi[1] &&
+                    b.z >= lo[2] && b.z <= hi[2])
+                    fn(b);
+            return;
+        }
+        for (int32_t z = int32_t(lo[2]); z <= int32_t(hi[2]); ++z)
+            for (int32_t y = int32_t(lo[1]); y <= int32_t(hi[1]); ++y)
+                for (int32_t x = int32_t(lo[0]); x <= int32_t(hi[0]); ++x) {
+                    int32_t i = findBucket(x, y, z);
+                    if (i >= 0 && !buckets[i].objects.empty()) fn(buckets[i]);
+                }
     }
 };
 
 // ---------------------------------------------
-// Octree partitioning
+// Dynamic AABB tree partitioning
+//
+// Incremental binary AABB tree for content that moves every frame. Leaves
+// store their bounds fattened by a margin, so an update whose new bounds
+// still fit the fat box costs nothing but a copy; otherwise the leaf is
+// removed and re-inserted. Insertion descends towards the sibling with the
+// lowest surface area cost, and rotations on the way back up keep the tree
+// close to height-balanced. Nodes live in one pool with a free list
+// threaded through the parent links.
+
+class DynamicAABBTree final {
+    static constexpr int32_t null = -1;
+
+    struct Node {
+        BoundingBox fat;        // inner: union of children
+        BoundingBox tight;      // leaves only: current world bounds
+        NodeHandle node;
+        int32_t parent = null;  // next free node while on the free list
+        int32_t child1 = null;
+        int32_t child2 = null;
+        int32_t height = 0;     // 0 for leaves, -1 for free nodes
+
+        bool isLeaf() const { return child1 == null; }
+    };
+
+    std::vector<Node> nodes;
+    int32_t root = null;
+    int32_t freeList = null;
+    HandleMap<int32_t> leaves;
+    float margin;
 
-class Octree : public PartitioningStrategy {
-    vec3 center;
-    float halfSize;
-    int depth;
-    std::vector<SceneNodePtr> objects;
-    std::array<std::unique_ptr<Octree>, 8> children;
 public:
-    Octree(const vec3& c, float hs, int d = 0)
-        : center(c), halfSize(hs), depth(d) {}
+    explicit DynamicAABBTree(float fatMargin = 0.5f) : margin(std::max(fatMargin, 0.0f)) {}
+
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || leaves.find(node)) return;
+        int32_t leaf = allocateNode();
+        Node& l = nodes[leaf];
+        l.node = node;
+        l.tight = n->worldBounds();
+        l.fat = fatten(l.tight);
+        leaves.set(node, leaf);
+        insertLeaf(leaf);
+    }
 
-    void insert(const SceneNodePtr& node) override {
-        objects.push_back(node);
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        int32_t* leaf = leaves.find(node);
+        if (!n || !leaf) { remove(node); insert(node); return; }
+        Node& l = nodes[*leaf];
+        l.tight = n->worldBounds();
+        if (l.fat.contains(l.tight)) return;
+        removeLeaf(*leaf);
+        l.fat = fatten(l.tight);
+        insertLeaf(*leaf);
     }
 
-    void clear() override {
-        objects.clear();
-        for (auto& ch : children) ch.reset();
+    void remove(NodeHandle node) {
+        int32_t* leaf = leaves.find(node);
+        if (!leaf) return;
+        int32_t index = *leaf;
+        leaves.erase(node);
+        removeLeaf(index);
+        freeNode(index);
     }
 
-    void subdivide() {
-        float h = halfSize * 0.5f;
-        for (int i = 0; i < 8; ++i) {
-            vec3 off(
-                (i & 1 ?  h : -h),
-                (i & 2 ?  h : -h),
-                (i & 4 ?  h : -h)
-            );
-            children[i] = std::make_unique<Octree>(center + off, h, depth + 1);
+    void clear() {
+        nodes.clear();
+        root = freeList = null;
+        leaves.clear();
+    }
+
+    void prepare() {}   // nothing is deferred
+
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const {
+        if (root == null) return;
+        std::vector<std::pair<int32_t, bool>> stack;   // (node, inside)
+        stack.reserve(64);
+        stack.push_back({root, false});
+        while (!stack.empty()) {
+            auto [index, inside] = stack.back();
+            stack.pop_back();
+            const Node& n = nodes[index];
+            if (!inside) {
+                auto c = culler.classify(n.fat);
+                if (c == FrustumCuller::Containment::Outside) continue;
+                inside = c == FrustumCuller::Containment::Inside;
+            }
+            if (n.isLeaf()) {
+                if (inside || culler.classify(n.tight) != FrustumCuller::Containment::Outside)
+                    out.push_back(n.node);
+                continue;
+            }
+            stack.push_back({n.child2, inside});
+            stack.push_back({n.child1, inside});
+        }
+    }
+
+    int32_t height() const { return root == null ? 0 : nodes[root].height; }
+
+private:
+    BoundingBox fatten(const BoundingBox& b) const {
+        return {b.min - vec3(margin), b.max + vec3(margin)};
+    }
+
+    int32_t allocateNode() {
+        if (freeList == null) {
+            nodes.emplace_back();
+            return int32_t(nodes.size() - 1);
+        }
+        int32_t index = freeList;
+        freeList = nodes[index].parent;
+        nodes[index] = Node();
+        return index;
+    }
+
+    void freeNode(int32_t index) {
+        nodes[index].parent = freeList;
+        nodes[index].height = -1;
+        freeList = index;
+    }
+
+    void replaceChild(int32_t parent, int32_t oldChild, int32_t newChild) {
+        if (parent == null) { root = newChild; return; }
+        if (nodes[parent].child1 == oldChild) nodes[parent].child1 = newChild;
+        else nodes[parent].child2 = newChild;
+    }
+
+    void insertLeaf(int32_t leaf) {
+        if (root == null) {
+            root = leaf;
+            nodes[leaf].parent = null;
+            return;
+        }
+
+        // Descend while the cost of pushing the leaf further down stays below
+        // the cost of pairing it with the current node.
+        BoundingBox box = nodes[leaf].fat;
+        int32_t index = root;
+        while (!nodes[index].isLeaf()) {
+            const Node& n = nodes[index];
+            float combined = BoundingBox::merge(n.fat, box).surfaceArea();
+            float cost = 2.0f * combined;
+            float inheritance = 2.0f * (combined - n.fat.surfaceArea());
+            auto childCost = [&](int32_t c) {
+                const Node& child = nodes[c];
+                float a = BoundingBox::merge(child.fat, box).surfaceArea();
+                return (child.isLeaf() ? a : a - child.fat.surfaceArea()) + inheritance;
+            };
+            float cost1 = childCost(n.child1);
+            float cost2 = childCost(n.child2);
+            if (cost < cost1 && cost < cost2) break;
+            index = cost1 < cost2 ? n.child1 : n.child2;
+        }
+
+        int32_t sibling = index;
+        int32_t oldParent = nodes[sibling].parent;
+        int32_t newParent = allocateNode();
+        Node& p = nodes[newParent];
+        p.parent = oldParent;
+        p.fat = BoundingBox::merge(box, nodes[sibling].fat);
+        p.height = nodes[sibling].height + 1;
+        p.child1 = sibling;
+        p.child2 = leaf;
+        replaceChild(oldParent, sibling, newParent);
+        nodes[sibling].parent = newParent;
+        nodes[leaf].parent = newParent;
+
+        refitUpwards(newParent);
+    }
+
+    void removeLeaf(int32_t leaf) {
+        if (leaf == root) {
+            root = null;
+            return;
+        }
+        int32_t parent = nodes[leaf].parent;
+        int32_t grandParent = nodes[parent].parent;
+        int32_t sibling = nodes[parent].child1 == leaf ? nodes[parent].child2 : nodes[parent].child1;
+
+        replaceChild(grandParent, parent, sibling);
+        nodes[sibling].parent = grandParent;
+        freeNode(parent);
+        if (grandParent != null) refitUpwards(grandParent);
+    }
+
+    // Rebalances and refits every node from index to the root.
+    void refitUpwards(int32_t index) {
+        while (index != null) {
+            index = balance(index);
+            Node& n = nodes[index];
+            n.height = 1 + std::max(nodes[n.child1].height, nodes[n.child2].height);
+            n.fat = BoundingBox::merge(nodes[n.child1].fat, nodes[n.child2].fat);
+            index = n.parent;
         }
     }
+
+    // Rotates the taller grandchild up when a's children differ in height by
+    // more than one. Returns the node now at a's position.
+    int32_t balance(int32_t iA) {
+        Node& a = nodes[iA];
+        if (a.isLeaf() || a.height < 2) return iA;
+
+        int32_t iB = a.child1, iC = a.child2;
+        int32_t diff = nodes[iC].height - nodes[iB].height;
+        if (diff > 1) return rotate(iA, iC, false);
+        if (diff < -1) return rotate(iA, iB, true);
+        return iA;
+    }
+
+    // Promotes child iUp of iA into iA's place. iA keeps its other child and
+    // adopts the shorter of iUp's children; iUp keeps the taller one.
+    int32_t rotate(int32_t iA, int32_t iUp, bool upIsFirst) {
+        Node& a = nodes[iA];
+        Node& up = nodes[iUp];
+        int32_t iF = up.child1, iG = up.child2;
+        Node& f = nodes[iF];
+        Node& g = nodes[iG];
+
+        up.child1 = iA;
+        up.parent = a.parent;
+        a.parent = iUp;
+        replaceChild(up.parent, iA, iUp);
+
+        int32_t keep = f.height > g.height ? iF : iG;
+        int32_t give = keep == iF ? iG : iF;
+        up.child2 = keep;
+        if (upIsFirst) a.child1 = give; else a.child2 = give;
+        nodes[give].parent = iA;
+
+        const Node& other = nodes[upIsFirst ? a.child2 : a.child1];
+        a.fat = BoundingBox::merge(other.fat, nodes[give].fat);
+        a.height = 1 + std::max(other.height, nodes[give].height);
+        up.fat = BoundingBox::merge(a.fat, nodes[keep].fat);
+        up.height = 1 + std::max(a.height, nodes[keep].height);
+        return iUp;
+    }
 };
 
 // ---------------------------------------------
-// BSP Tree partitioning
+// Static dispatch
+//
+// SpatialPartitioner names what every partitioner above provides. Scene<P>
+// drives a concrete partitioner with direct calls that the compiler can
+// inline; PartitionerAdapter<P> puts one behind PartitioningStrategy when it
+// has to be chosen at runtime, as in the UI.
+
+// The same requirements as a detection-idiom trait, so PartitionerAdapter
+// and Scene reject a non-conforming P with a static_assert when the compiler
+// has no concepts and SG_PARTITIONER falls back to a plain typename.
+template <typename P, typename = void>
+struct IsSpatialPartitioner : std::false_type {};
+
+template <typename P>
+struct IsSpatialPartitioner<P, std::void_t<
+    decltype(std::declval<P&>().insert(NodeHandle())),
+    decltype(std::declval<P&>().update(NodeHandle())),
+    decltype(std::declval<P&>().remove(NodeHandle())),
+    decltype(std::declval<P&>().clear()),
+    decltype(std::declval<P&>().prepare()),
+    decltype(std::declval<const P&>().query(std::declval<const FrustumCuller&>(),
+                                            std::declval<std::vector<NodeHandle>&>()))>>
+    : std::true_type {};
+
+#if defined(__cpp_concepts) && __cpp_concepts >= 201907L
+template <typename P>
+concept SpatialPartitioner = requires(P p, const P cp, NodeHandle h,
+                                      const FrustumCuller& culler, std::vector<NodeHandle>& out) {
+    p.insert(h);
+    p.update(h);
+    p.remove(h);
+    p.clear();
+    p.prepare();
+    cp.query(culler, out);
+};
+#define SG_PARTITIONER SpatialPartitioner
+#else
+#define SG_PARTITIONER typename
+#endif
+
+template <SG_PARTITIONER P>
+class PartitionerAdapter final : public PartitioningStrategy {
+    static_assert(IsSpatialPartitioner<P>::value,
+                  "P needs insert/update/remove/clear/prepare and a const query");
+    P impl;
+
+public:
+    template <typename... Args>
+    explicit PartitionerAdapter(Args&&... args) : impl(std::forward<Args>(args)...) {}
+
+    P& get() { return impl; }
+    const P& get() const { return impl; }
+
+    using PartitioningStrategy::insert;
+    void insert(NodeHandle node) override { impl.insert(node); }
+    void update(NodeHandle node) override { impl.update(node); }
+    void remove(NodeHandle node) override { impl.remove(node); }
+    void clear() override { impl.clear(); }
+    void prepare() override { impl.prepare(); }
+    void query(const FrustumCuller& culler, std::vector<NodeHandle>& out) const override {
+        impl.query(culler, out);
+    }
+};
+
+template <SG_PARTITIONER P, typename... Args>
+std::unique_ptr<PartitioningStrategy> makePartitioner(Args&&... args) {
+    return std::make_unique<PartitionerAdapter<P>>(std::forward<Args>(args)...);
+}
+
+// A scene graph with its flattened hierarchy and a partitioner of fixed type.
+template <SG_PARTITIONER P>
+class Scene {
+    static_assert(IsSpatialPartitioner<P>::value,
+                  "P needs insert/update/remove/clear/prepare and a const query");
+    SceneNodePtr root;
+    LinearHierarchy hierarchy;
+    P spatial;
 
-class BSPTree : public PartitioningStrategy {
-    vec3 normal;
-    float distance;
-    std::vector<SceneNodePtr> frontList, backList;
-    std::unique_ptr<BSPTree> front, back;
 public:
-    BSPTree(const vec3& n, float d)
-        : normal(n), distance(d) {}
+    template <typename... Args>
+    explicit Scene(SceneNodePtr r, Args&&... args)
+        : root(std::move(r)), spatial(std::forward<Args>(args)...) { rebuild(); }
+
+    P& partitioner() { return spatial; }
+    const LinearHierarchy& linear() const { return hierarchy; }
+
+    // Re-flattens the tree and re-inserts every node; needed after nodes
+    // were added or removed.
+    void rebuild() {
+        hierarchy.rebuild(root);
+        hierarchy.update(true);
+        spatial.clear();
+        for (auto* n : hierarchy.nodes) spatial.insert(n->handle);
+        spatial.prepare();
+    }
 
-    void insert(const SceneNodePtr& node) override {
-        frontList.push_back(node);
+    // Propagates transforms and moves the nodes whose world matrix changed.
+    // Leaves the partitioner prepared, so cull() may run on several threads.
+    void update(JobSystem* jobs = nullptr) {
+        hierarchy.update(false, jobs);
+        for (size_t i = 0; i < hierarchy.size(); ++i)
+            if (hierarchy.moved[i]) spatial.update(hierarchy.nodes[i]->handle);
+        spatial.prepare();
     }
 
-    void clear() override {
-        frontList.clear();
-        backList.clear();
-        front.reset();
-        back.reset();
+    // Appends the visible nodes.
+    void cull(const FrustumCuller& culler, std::vector<NodeHandle>& visible) const {
+        size_t first = visible.size();
+        spatial.query(culler, visible);
+        auto end = std::remove_if(visible.begin() + first, visible.end(),
+                                  [&](NodeHandle h) { return !culler.isVisible(h); });
+        visible.erase(end, visible.end());
     }
 };
 
 // ---------------------------------------------
-// Frustum Culling
+// Broadphase (sweep and prune)
+//
+// Collects the pairs of nodes whose world AABBs overlap. Proxies are kept
+// sorted by their minimum on the axis along which the centers vary most;
+// since objects move little between frames, an insertion sort restores the
+// order in close to linear time. step() sweeps the sorted list and reports
+// only the pairs that began or stopped overlapping since the previous step.
+
+class SweepAndPrune {
+public:
+    struct Pair {
+        NodeHandle a, b;   // a.index < b.index
+    };
 
-class FrustumCuller {
-    std::array<vec4,6> planes;
+private:
+    struct Proxy {
+        NodeHandle node;
+        BoundingBox bounds;
+        bool live = true;
+    };
+
+    std::vector<Proxy> proxies;                       // sorted by bounds.min[axis] after step()
+    HandleMap<uint32_t> slots;                        // index into proxies
+    std::vector<std::pair<uint64_t, Pair>> current;   // overlapping pairs, sorted by key
+    std::vector<std::pair<uint64_t, Pair>> found;     // scratch for step()
+    size_t dead = 0;
+    size_t appended = 0;
+    int axis = 0;
 
-    void extractPlanes(const mat4& m) {
-        planes[0] = glm::row(m,3) + glm::row(m,0);
-        planes[1] = glm::row(m,3) - glm::row(m,0);
-        planes[2] = glm::row(m,3) + glm::row(m,1);
-        planes[3] = glm::row(m,3) - glm::row(m,1);
-        planes[4] = glm::row(m,3) + glm::row(m,2);
-        planes[5] = glm::row(m,3) - glm::row(m,2);
-        for (auto& p : planes) {
-            float l = glm::length(glm::vec3(p));
-            p /= l;
-        }
+public:
+    void insert(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        if (!n || slots.find(node)) return;
+        slots.set(node, uint32_t(proxies.size()));
+        proxies.push_back({node, n->worldBounds()});
+        ++appended;
     }
 
-public:
-    FrustumCuller(const mat4& projView) {
-        extractPlanes(projView);
+    void update(NodeHandle node) {
+        SceneNode* n = SceneNode::fromHandle(node);
+        uint32_t* slot = slots.find(node);
+        if (!n || !slot) { remove(node); insert(node); return; }
+        proxies[*slot].bounds = n->worldBounds();
     }
 
-    bool isVisible(const SceneNodePtr& node) const {
-        mat4 wm = node->getWorldMatrix();
-        auto bb = node->boundingBox;
-        vec3 pts[8] = {
-            {bb.min.x,bb.min.y,bb.min.z},{bb.max.x,bb.min.y,bb.min.z},
-            {bb.min.x,bb.max.y,bb.min.z},{bb.max.x,bb.max.y,bb.min.z},
-            {bb.min.x,bb.min.y,bb.max.z},{bb.max.x,bb.min.y,bb.max.z},
-            {bb.min.x,bb.max.y,bb.max.z},{bb.max.x,bb.max.y,bb.max.z}
-        };
-        for (auto& plane : planes) {
-            int out = 0;
-            for (auto& p : pts) {
-                vec4 wp = wm * vec4(p,1.0f);
-                if (glm::dot(glm::vec3(plane), glm::vec3(wp)) + plane.w < 0) out++;
+    // Pairs involving the node are reported as removed by the next step().
+    void remove(NodeHandle node) {
+        uint32_t* slot = slots.find(node);
+        if (!slot) return;
+        proxies[*slot].live = false;
+        slots.erase(node);
+        ++dead;
+    }
+
+    void clear() {
+        for (auto& p : proxies) p.live = false;
+        dead = proxies.size();
+        slots.clear();
+    }
+
+    const std::vector<std::pair<uint64_t, Pair>>& pairs() const { return current; }
+    int sortAxis() const { return axis; }
+
+    // Re-sorts and sweeps, appending the pair changes since the last step.
+    void step(std::vector<Pair>& added, std::vector<Pair>& removed) {
+        if (dead > 0) {
+            proxies.erase(std::remove_if(proxies.begin(), proxies.end(),
+                                         [](const Proxy& p) { return !p.live; }),
+                          proxies.end());
+            dead = 0;
+        }
+        sort();
+
+        found.clear();
+        size_t n = proxies.size();
+        int a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+        for (size_t i = 0; i < n; ++i) {
+            const Proxy& p = proxies[i];
+            float end = p.bounds.max[axis];
+            for (size_t j = i + 1; j < n && proxies[j].bounds.min[axis] <= end; ++j) {
+                const BoundingBox& q = proxies[j].bounds;
+                if (q.min[a1] > p.bounds.max[a1] || q.max[a1] < p.bounds.min[a1] ||
+                    q.min[a2] > p.bounds.max[a2] || q.max[a2] < p.bounds.min[a2])
+                    continue;
+                NodeHandle x = p.node, y = proxies[j].node;
+                if (y.index < x.index) std::swap(x, y);
+                found.push_back({(uint64_t(x.index) << 32) | y.index, {x, y}});
             }
-            if (out == 8) { 
-                node->visible = false;
-                return false;
+        }
+        std::sort(found.begin(), found.end(),
+                  [](const auto& l, const auto& r) { return l.first < r.first; });
+
+        // Pairs whose nodes were removed (even if the index has been reused
+        // since) cannot match anything new.
+        size_t kept = 0;
+        for (auto& c : current) {
+            if (slots.find(c.second.a) && slots.find(c.second.b)) current[kept++] = c;
+            else removed.push_back(c.second);
+        }
+        current.resize(kept);
+
+        size_t i = 0, j = 0;
+        while (i < current.size() || j < found.size()) {
+            if (j == found.size() || (i < current.size() && current[i].first < found[j].first))
+                removed.push_back(current[i++].second);
+            else if (i == current.size() || found[j].first < current[i].first)
+                added.push_back(found[j++].second);
+            else { ++i; ++j; }
+        }
+        current.swap(found);
+    }
+
+private:
+    // Picks the axis of greatest center variance. A changed axis or many new
+    // proxies call for a full sort; otherwise the previous order is nearly
+    // right and an insertion sort fixes it.
+    void sort() {
+        size_t n = proxies.size();
+        vec3 sum(0.0f), sumSq(0.0f);
+        for (auto& p : proxies) {
+            vec3 c = p.bounds.center();
+            sum += c;
+            sumSq += c * c;
+        }
+        int best = axis;
+        if (n > 1) {
+            vec3 variance = sumSq - sum * sum / float(n);
+            best = variance.x > variance.y ? (variance.x > variance.z ? 0 : 2)
+                                           : (variance.y > variance.z ? 1 : 2);
+        }
+
+        auto less = [a = best](const Proxy& l, const Proxy& r) { return l.bounds.min[a] < r.bounds.min[a]; };
+        if (best != axis || appended * 4 > n) {
+            axis = best;
+            std::sort(proxies.begin(), proxies.end(), less);
+        } else {
+            for (size_t i = 1; i < n; ++i) {
+                if (!less(proxies[i], proxies[i - 1])) continue;
+                Proxy p = proxies[i];
+                size_t j = i;
+                for (; j > 0 && less(p, proxies[j - 1]); --j) proxies[j] = proxies[j - 1];
+                proxies[j] = p;
             }
         }
-        node->visible = true;
-        return true;
+        appended = 0;
+        for (uint32_t i = 0; i < n; ++i) slots.set(proxies[i].node, i);
     }
 };
 
@@ -259,61 +3531,79 @@ public:
 // Serialization / Deserialization
 
 class Serializer {
-    static void serializeNode(const SceneNodePtr& node, std::ostream& os, int indent = 0) {
+    // Reads through a reused token buffer: operator>> for float allocates a
+    // scratch string per value in libstdc++.
+    static float readFloat(std::istream& is, std::string& buf) {
+        is >> buf;
+        return std::strtof(buf.c_str(), nullptr);
+    }
+
+    static void serializeNode(const SceneNode& node, std::ostream& os, int indent = 0) {
         std::string ind(indent, ' ');
-        os << ind << "Node " << node->name << "\n";
+        os << ind << "Node " << node.name << "\n";
 
-        auto pos = node->transform.getPosition();
-        auto rot = node->transform.getRotation();
-        auto scl = node->transform.getScale();
+        auto pos = node.transform.getPosition();
+        auto rot = node.transform.getRotation();
+        auto scl = node.transform.getScale();
         os << ind << "  Position " << pos.x << " " << pos.y << " " << pos.z << "\n";
         os << ind << "  Rotation " << rot.x << " " << rot.y << " " << rot.z << " " << rot.w << "\n";
         os << ind << "  Scale "    << scl.x << " " << scl.y << " " << scl.z << "\n";
 
-        os << ind << "  LODLevels " << node->lod.levels.size() << "\n";
-        for (auto& lvl : node->lod.levels)
+        os << ind << "  LODLevels " << node.lod.levels.size() << "\n";
+        for (auto& lvl : node.lod.levels)
             os << ind << "    " << lvl.distanceThreshold << " " << lvl.meshName << "\n";
 
         os << ind << "  BoundingBox "
-           << node->boundingBox.min.x << " " << node->boundingBox.min.y << " " << node->boundingBox.min.z << " "
-           << node->boundingBox.max.x << " " << node->boundingBox.max.y << " " << node->boundingBox.max.z << "\n";
+           << node.boundingBox.min.x << " " << node.boundingBox.min.y << " " << node.boundingBox.min.z << " "
+           << node.boundingBox.max.x << " " << node.boundingBox.max.y << " " << node.boundingBox.max.z << "\n";
 
-        os << ind << "  Children " << node->children.size() << "\n";
-        for (auto& c : node->children)
-            serializeNode(c, os, indent + 4);
+        os << ind << "  Children " << node.children.size() << "\n";
+        for (auto& c : node.children)
+            serializeNode(*c, os, indent + 4);
     }
 
 public:
     static void serialize(const SceneNodePtr& root, const std::string& filename) {
         std::ofstream ofs(filename);
-        serializeNode(root, ofs);
+        serializeNode(*root, ofs);
     }
 
-    static SceneNodePtr deserialize(const std::string& filename) {
+    static bool serialize(NodeHandle root, const std::string& filename) {
+        SceneNode* node = SceneNode::fromHandle(root);
+        if (!node) return false;
+        std::ofstream ofs(filename);
+        serializeNode(*node, ofs);
+        return true;
+    }
+
+    // Nodes come from pool when one is given; it must outlive the returned tree.
+    static SceneNodePtr deserialize(const std::string& filename, ScenePool* pool = nullptr) {
         std::ifstream ifs(filename);
+        std::string buf;    // reused read buffer; names are interned before recursing
+        auto num = [&](std::istream& is) { return readFloat(is, buf); };
         std::function<SceneNodePtr(std::istream&)> deser = [&](std::istream& is)->SceneNodePtr {
             std::string tok;
             if (!(is >> tok) || tok != "Node") return nullptr;
-            std::string name; is >> name;
-            auto node = std::make_shared<SceneNode>(name);
+            is >> buf;
+            auto node = pool ? pool->makeNode(Symbol(buf))
+                             : std::make_shared<SceneNode>(Symbol(buf));
 
-            is >> tok; float px,py,pz; is >> px >> py >> pz;
-            node->transform.setPosition({px,py,pz});
-            is >> tok; float rx,ry,rz,rw; is >> rx >> ry >> rz >> rw;
+            is >> tok; vec3 pos{num(is), num(is), num(is)};
+            node->transform.setPosition(pos);
+            is >> tok; float rx = num(is), ry = num(is), rz = num(is), rw = num(is);
             node->transform.setRotation({rw,rx,ry,rz});
-            is >> tok; float sx,sy,sz; is >> sx >> sy >> sz;
-            node->transform.setScale({sx,sy,sz});
+            is >> tok; vec3 scl{num(is), num(is), num(is)};
+            node->transform.setScale(scl);
 
             is >> tok; int lodCount; is >> lodCount;
             for (int i = 0; i < lodCount; ++i) {
-                float d; std::string m; is >> d >> m;
-                node->lod.addLevel(d,m);
+                float d = num(is); is >> buf;
+                node->lod.addLevel(d, Symbol(buf));
             }
 
-            is >> tok; float minx,miny,minz,maxx,maxy,maxz;
-            is >> minx >> miny >> minz >> maxx >> maxy >> maxz;
-            node->boundingBox.min = {minx,miny,minz};
-            node->boundingBox.max = {maxx,maxy,maxz};
+            is >> tok;
+            node->boundingBox.min = {num(is), num(is), num(is)};
+            node->boundingBox.max = {num(is), num(is), num(is)};
 
             is >> tok; int childCount; is >> childCount;
             for (int i = 0; i < childCount; ++i) {
@@ -331,12 +3621,22 @@ public:
 // Minimal CLI UI
 
 class UI {
+    std::unique_ptr<ScenePool> pool;   // declared before root so it outlives the nodes
     SceneNodePtr root;
+    NameIndex names;
+    LinearHierarchy hierarchy;
+    bool hierarchyDirty = true;
     std::unique_ptr<PartitioningStrategy> partitioner;
+    bool partitionerDirty = true;            // needs a full re-insert
+    std::vector<NodeHandle> removedNodes;    // to drop from the partitioner
+    FrustumCuller culler{mat4(1.0f)};        // kept across culls for its coherence state
 public:
     UI()
-        : root(std::make_shared<SceneNode>("Root")),
-          partitioner(std::make_unique<Octree>(vec3(0.0f), 100.0f)) {}
+        : pool(std::make_unique<ScenePool>()),
+          root(pool->makeNode(Symbol("Root"))),
+          partitioner(makePartitioner<Octree>(vec3(0.0f), 100.0f)) {
+        names.attach(root);
+    }
 
     void run() {
         int choice = 0;
@@ -357,7 +3657,7 @@ public:
                 case 1: addNode();         break;
                 case 2: removeNode();      break;
                 case 3: moveNode();        break;
-                case 4: printGraph(root,0);break;
+                case 4: printGraph();      break;
                 case 5: serializeScene();  break;
                 case 6: deserializeScene();break;
                 case 7: switchPartitioner();break;
@@ -370,32 +3670,43 @@ private:
     void addNode() {
         std::string parentName, nodeName;
         std::cout << "Parent Name: "; std::cin >> parentName;
-        auto parent = findNode(parentName, root);
+        auto parent = findNode(parentName);
         if (!parent) { std::cout << "Parent not found\n"; return; }
         std::cout << "Node Name: ";  std::cin >> nodeName;
-        parent->addChild(std::make_shared<SceneNode>(nodeName));
+        parent->addChild(pool->makeNode(Symbol(nodeName)));
+        hierarchyDirty = true;
     }
 
     void removeNode() {
         std::string name;
         std::cout << "Node Name: "; std::cin >> name;
-        auto node = findNode(name, root);
-        if (node && node->parent.lock())
+        auto node = findNode(name);
+        if (node && node->parent.lock()) {
+            std::vector<SceneNode*> stack{node.get()};
+            while (!stack.empty()) {
+                SceneNode* n = stack.back();
+                stack.pop_back();
+                removedNodes.push_back(n->handle);
+                for (auto& c : n->children) stack.push_back(c.get());
+            }
             node->parent.lock()->removeChild(node);
+            hierarchyDirty = true;
+        }
     }
 
     void moveNode() {
         std::string name;
         float x,y,z;
         std::cout << "Node Name: ";        std::cin >> name;
-        auto node = findNode(name, root);
+        auto node = findNode(name);
         if (!node) return;
         std::cout << "New Position x y z: "; std::cin >> x >> y >> z;
         node->transform.setPosition({x,y,z});
     }
 
-    void printGraph(const SceneNodePtr& node, int depth) {
-        node->draw(depth);
+    void printGraph() {
+        syncHierarchy();
+        hierarchy.draw();
     }
 
     void serializeScene() {
@@ -407,52 +3718,100 @@ private:
     void deserializeScene() {
         std::string filename;
         std::cout << "Filename: "; std::cin >> filename;
-        auto newRoot = Serializer::deserialize(filename);
-        if (newRoot) root = newRoot;
+        auto newPool = std::make_unique<ScenePool>();
+        auto newRoot = Serializer::deserialize(filename, newPool.get());
+        if (newRoot) {
+            root = std::move(newRoot);
+            pool = std::move(newPool);
+            names.attach(root);
+            hierarchyDirty = true;
+            partitionerDirty = true;
+        }
     }
 
     void switchPartitioner() {
         int c;
-        std::cout << "1.Octree 2.BSP: ";
+        std::cout << "1.Octree 2.BSP 3.Loose Octree 4.Linear Octree 5.BVH 6.BVH (refit) 7.Hash Grid 8.AABB Tree: ";
         std::cin >> c;
         if (c == 1)
-            partitioner = std::make_unique<Octree>(vec3(0.0f), 100.0f);
+            partitioner = makePartitioner<Octree>(vec3(0.0f), 100.0f);
+        else if (c == 3)
+            partitioner = makePartitioner<LooseOctree>(vec3(0.0f), 100.0f);
+        else if (c == 4)
+            partitioner = makePartitioner<LinearOctree>(vec3(0.0f), 100.0f);
+        else if (c == 5)
+            partitioner = makePartitioner<BVH>();
+        else if (c == 6) {
+            auto bvh = std::make_unique<PartitionerAdapter<BVH>>();
+            bvh->get().setRefitMode(true);
+            partitioner = std::move(bvh);
+        }
+        else if (c == 7)
+            partitioner = makePartitioner<SpatialHashGrid>(10.0f);
+        else if (c == 8)
+            partitioner = makePartitioner<DynamicAABBTree>();
         else
-            partitioner = std::make_unique<BSPTree>(vec3(0,1,0), 0.0f);
+            partitioner = makePartitioner<BSPTree>();
+        partitionerDirty = true;
+    }
+
+    void syncHierarchy() {
+        if (hierarchyDirty) hierarchy.rebuild(root);
+        hierarchyDirty = false;
+    }
+
+    // Full re-insert after a partitioner switch or a new scene; otherwise
+    // only removed nodes and nodes whose world matrix changed are touched.
+    void updatePartitioner() {
+        if (partitionerDirty) {
+            partitioner->clear();
+            for (auto* n : hierarchy.nodes)
+                partitioner->insert(n->handle);
+            partitionerDirty = false;
+        } else {
+            for (auto h : removedNodes)
+                partitioner->remove(h);
+            for (size_t i = 0; i < hierarchy.size(); ++i)
+                if (hierarchy.moved[i]) partitioner->update(hierarchy.nodes[i]->handle);
+        }
+        removedNodes.clear();
+        partitioner->prepare();
     }
 
     void cullAndPrint() {
-        partitioner->clear();
-        std::vector<SceneNodePtr> all;
-        std::function<void(SceneNodePtr)> gather = [&](SceneNodePtr n){
-            all.push_back(n);
-            for (auto& c : n->children) gather(c);
-        };
-        gather(root);
+        syncHierarchy();
+        hierarchy.update(false, &jobSystem());
+        updatePartitioner();
 
-        for (auto& n : all)
-            partitioner->insert(n);
+        culler.setViewProjection(mat4(1.0f));
+        std::vector<NodeHandle> candidates;
+        partitioner->query(culler, candidates);
 
-        FrustumCuller culler(mat4(1.0f));
+        for (auto* n : hierarchy.nodes) n->visible = false;
+        culler.cullCandidates(candidates);
         std::cout << "Visible Nodes:\n";
-        for (auto& n : all)
-            if (culler.isVisible(n))
-                std::cout << "  " << n->name << "\n";
+        for (auto h : candidates)
+            std::cout << "  " << SceneNode::fromHandle(h)->name << "\n";
+
+        const auto& stats = culler.coherenceStats();
+        std::cout << "Plane cache hit rate: " << stats.hitRate() * 100.0f << "% ("
+                  << stats.cachedHits << "/" << stats.cachedTests << ")\n";
     }
 
-    SceneNodePtr findNode(const std::string& name, const SceneNodePtr& node) {
-        if (node->name == name) return node;
-        for (auto& c : node->children)
-            if (auto r = findNode(name, c)) return r;
-        return nullptr;
+    SceneNodePtr findNode(const std::string& name) {
+        SceneNode* node = names.lookup(name);
+        return node ? node->shared_from_this() : nullptr;
     }
 };
 
 // ---------------------------------------------
 // Main entry point
+// Tests define SCENE_GRAPH_NO_MAIN and include this file directly.
 
+#ifndef SCENE_GRAPH_NO_MAIN
 int main() {
     UI ui;
     ui.run();
     return 0;
 }
+#endif
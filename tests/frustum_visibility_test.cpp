@@ -0,0 +1,80 @@
+// Randomized check that FrustumCuller::isVisible(SceneNode&), which tests a
+// world center plus three scaled world axes, agrees with the 8-corner test it
+// replaced. Returns non-zero on any disagreement away from a plane boundary.
+
+#define SCENE_GRAPH_NO_MAIN
+#include "../Graph.cpp"
+
+#include <cstdio>
+#include <random>
+
+// ---------------------------------------------
+// Reference: transform all 8 local corners and reject the box if every one
+// of them is behind the same plane. Also returns, through margin, how far the
+// deciding corner lies from its plane so boundary cases can be told apart.
+
+static bool cornersVisible(const std::array<vec4,6>& planes, const mat4& wm, const BoundingBox& bb, float& margin) {
+    vec3 pts[8] = {
+        {bb.min.x,bb.min.y,bb.min.z},{bb.max.x,bb.min.y,bb.min.z},
+        {bb.min.x,bb.max.y,bb.min.z},{bb.max.x,bb.max.y,bb.min.z},
+        {bb.min.x,bb.min.y,bb.max.z},{bb.max.x,bb.min.y,bb.max.z},
+        {bb.min.x,bb.max.y,bb.max.z},{bb.max.x,bb.max.y,bb.max.z}
+    };
+    margin = std::numeric_limits<float>::max();
+    for (auto& plane : planes) {
+        float farthest = -std::numeric_limits<float>::max();
+        for (auto& p : pts) {
+            vec4 wp = wm * vec4(p, 1.0f);
+            farthest = std::max(farthest, glm::dot(vec3(plane), vec3(wp)) + plane.w);
+        }
+        margin = std::min(margin, std::fabs(farthest));
+        if (farthest < 0) return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------
+
+int main() {
+    const int boxes = 200000;
+    const float boundary = 1e-3f;
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> pos(-120.0f, 120.0f), unit(-1.0f, 1.0f), size(0.05f, 5.0f);
+
+    mat4 viewProj = glm::perspective(1.1f, 1.5f, 0.3f, 150.0f) *
+                    glm::lookAt(vec3(5, 3, -40), vec3(30, -10, 60), vec3(0, 1, 0));
+    FrustumCuller culler(viewProj);
+
+    auto root = std::make_shared<SceneNode>("root");
+    std::vector<SceneNodePtr> nodes;
+    nodes.reserve(boxes);
+    for (int i = 0; i < boxes; ++i) {
+        auto n = std::make_shared<SceneNode>("box");
+        vec3 lo(unit(rng) * 3, unit(rng) * 3, unit(rng) * 3);
+        n->boundingBox = {lo, lo + vec3(size(rng), size(rng), size(rng))};
+        n->transform.setPosition({pos(rng), pos(rng), pos(rng)});
+        n->transform.setRotation(glm::normalize(quat(unit(rng), unit(rng), unit(rng), unit(rng))));
+        n->transform.setScale(vec3(size(rng), size(rng), size(rng)));
+        root->addChild(n);
+        nodes.push_back(n);
+    }
+    root->updateWorldMatrix(true);
+
+    int visible = 0, onBoundary = 0, mismatches = 0;
+    for (auto& n : nodes) {
+        float margin;
+        bool expected = cornersVisible(culler.getPlanes(), n->getWorldMatrix(), n->boundingBox, margin);
+        bool actual = culler.isVisible(*n);
+        visible += actual;
+        if (actual == expected) continue;
+        if (margin < boundary) { ++onBoundary; continue; }
+        if (++mismatches <= 10)
+            std::printf("mismatch: box %zu expected %d got %d (margin %g)\n",
+                        size_t(&n - nodes.data()), expected, actual, margin);
+    }
+
+    std::printf("%d boxes, %d visible, %d boundary differences, %d mismatches\n",
+                boxes, visible, onBoundary, mismatches);
+    return mismatches ? 1 : 0;
+}
@@ -0,0 +1,170 @@
+// Checks every partitioner against a brute-force frustum test while nodes are
+// inserted (twice), moved, re-inserted through update() and removed, including
+// removes and updates through handles of nodes already destroyed. A query must
+// return every visible node once, and nothing removed or destroyed. Returns
+// non-zero on any failure.
+
+#define SCENE_GRAPH_NO_MAIN
+#include "../Graph.cpp"
+
+#include <cstdio>
+#include <random>
+#include <unordered_set>
+
+struct Candidate {
+    const char* name;
+    std::function<std::unique_ptr<PartitioningStrategy>()> make;
+};
+
+static JobSystem& testJobs() {
+    static JobSystem jobs(2);
+    return jobs;
+}
+
+static std::vector<Candidate> candidates() {
+    return {
+        {"Octree",          []{ return makePartitioner<Octree>(vec3(0.0f), 128.0f); }},
+        {"LooseOctree",     []{ return makePartitioner<LooseOctree>(vec3(0.0f), 128.0f); }},
+        {"LinearOctree",    []{ return makePartitioner<LinearOctree>(vec3(0.0f), 128.0f); }},
+        {"BSPTree",         []{ return makePartitioner<BSPTree>(); }},
+        {"BVH",             []{ return makePartitioner<BVH>(); }},
+        {"BVH (refit)",     []() -> std::unique_ptr<PartitioningStrategy> {
+                                auto bvh = std::make_unique<PartitionerAdapter<BVH>>(4, &testJobs());
+                                bvh->get().setRefitMode(true, 1.2f);
+                                return bvh;
+                            }},
+        {"SpatialHashGrid", []{ return makePartitioner<SpatialHashGrid>(5.0f); }},
+        {"DynamicAABBTree", []{ return makePartitioner<DynamicAABBTree>(); }},
+    };
+}
+
+// ---------------------------------------------
+// Brute-force comparison
+
+struct Checker {
+    const char* name;
+    int failures = 0;
+
+    // Queries part (optionally without prepare(), which must still be
+    // correct) and compares against isVisible() over the expected set.
+    void check(const char* step, PartitioningStrategy& part, const FrustumCuller& culler,
+               const std::vector<SceneNodePtr>& expected, const std::vector<NodeHandle>& gone,
+               bool prepare) {
+        if (prepare) part.prepare();
+        std::vector<NodeHandle> out;
+        part.query(culler, out);
+
+        std::unordered_set<uint64_t> seen;
+        int duplicates = 0, stale = 0, missing = 0, removed = 0;
+        for (NodeHandle h : out) {
+            if (!seen.insert(key(h)).second) ++duplicates;
+            if (!SceneNode::fromHandle(h)) ++stale;
+        }
+        for (NodeHandle h : gone)
+            if (seen.count(key(h))) ++removed;
+        for (auto& n : expected)
+            if (culler.isVisible(*n) && !seen.count(key(n->handle))) ++missing;
+
+        if (duplicates || stale || missing || removed) {
+            std::printf("%s, %s%s: %d missing, %d duplicates, %d stale, %d removed\n", name, step,
+                        prepare ? "" : " (unprepared)", missing, duplicates, stale, removed);
+            ++failures;
+        }
+    }
+
+    static uint64_t key(NodeHandle h) { return (uint64_t(h.generation) << 32) | h.index; }
+};
+
+// ---------------------------------------------
+
+static int run(const Candidate& candidate, bool prepare) {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> pos(-110.0f, 110.0f), size(0.1f, 4.0f), step(-5.0f, 5.0f);
+
+    auto root = std::make_shared<SceneNode>("root");
+    std::vector<SceneNodePtr> nodes{root};
+    for (int i = 0; i < 5000; ++i) {
+        auto n = std::make_shared<SceneNode>("box");
+        n->transform.setPosition({pos(rng), pos(rng), pos(rng)});
+        n->transform.setScale(vec3(size(rng) * (i % 100 == 0 ? 10.0f : 1.0f)));
+        nodes[i % 7 == 0 ? rng() % nodes.size() : 0]->addChild(n);
+        nodes.push_back(n);
+    }
+    LinearHierarchy hierarchy;
+    hierarchy.rebuild(root);
+    hierarchy.update(true);
+
+    FrustumCuller culler(glm::perspective(1.0f, 1.3f, 0.5f, 200.0f) *
+                         glm::lookAt(vec3(0, 0, -50), vec3(100, 0, 0), vec3(0, 1, 0)));
+    Checker checker{candidate.name};
+    std::vector<NodeHandle> gone;
+    auto part = candidate.make();
+
+    // Inserting a node that is already held must not leave a second entry.
+    for (auto& n : nodes) part->insert(n->handle);
+    for (size_t i = 0; i < nodes.size(); i += 2) part->insert(nodes[i]->handle);
+    checker.check("insert", *part, culler, nodes, gone, prepare);
+
+    for (int frame = 0; frame < 10; ++frame) {
+        for (size_t i = 1; i < nodes.size(); i += 3)
+            nodes[i]->transform.setPosition(nodes[i]->transform.getPosition() + vec3(step(rng), step(rng), step(rng)));
+        hierarchy.update();
+        for (size_t i = 0; i < hierarchy.size(); ++i)
+            if (hierarchy.moved[i]) part->update(hierarchy.nodes[i]->handle);
+    }
+    checker.check("update", *part, culler, nodes, gone, prepare);
+
+    // Remove leaves; every other one is destroyed before the partitioner
+    // hears about it, so remove() and update() see a stale handle.
+    std::vector<NodeHandle> destroyed;
+    for (size_t i = 1; i < nodes.size(); i += 5) {
+        if (!nodes[i]->children.empty()) continue;
+        NodeHandle h = nodes[i]->handle;
+        nodes[i]->parent.lock()->removeChild(nodes[i]);
+        gone.push_back(h);
+        if (gone.size() % 2) { nodes[i].reset(); destroyed.push_back(h); }
+        else part->remove(h);
+    }
+    for (NodeHandle h : destroyed) {
+        part->update(h);
+        part->remove(h);
+        part->remove(h);
+    }
+    nodes.erase(std::remove(nodes.begin(), nodes.end(), nullptr), nodes.end());
+    std::vector<SceneNodePtr> held;
+    for (auto& n : nodes)
+        if (!n->parent.expired() || n == root) held.push_back(n);
+    hierarchy.rebuild(root);
+    hierarchy.update();
+    for (size_t i = 0; i < hierarchy.size(); ++i)
+        if (hierarchy.moved[i]) part->update(hierarchy.nodes[i]->handle);
+    checker.check("remove", *part, culler, held, gone, prepare);
+
+    // A removed node that comes back through update() is held again.
+    SceneNodePtr back;
+    for (auto& n : nodes)
+        if (n != root && n->parent.expired()) { back = n; break; }
+    if (back) {
+        root->addChild(back);
+        part->update(back->handle);
+        gone.erase(std::remove(gone.begin(), gone.end(), back->handle), gone.end());
+        held.push_back(back);
+        hierarchy.rebuild(root);
+        hierarchy.update();
+        checker.check("re-insert", *part, culler, held, gone, prepare);
+    }
+
+    part->clear();
+    checker.check("clear", *part, culler, {}, gone, prepare);
+    return checker.failures;
+}
+
+int main() {
+    int failures = 0;
+    for (auto& candidate : candidates()) {
+        int f = run(candidate, true) + run(candidate, false);
+        std::printf("%-16s %s\n", candidate.name, f ? "FAILED" : "ok");
+        failures += f;
+    }
+    return failures ? 1 : 0;
+}